@@ -0,0 +1,69 @@
+#ifndef ANAV_LOG_H
+#define ANAV_LOG_H
+
+/* Log output of the shell's own features, with the provided log_anav_*
+ * helpers of logging.h */
+
+void log_anav_builtins();
+void log_anav_pipe_grouped(int task_num, const char *group);
+void log_anav_usage(const char *prog);
+void log_anav_open_error(const char *file);
+void log_anav_shm(const char *name, int slots);
+void log_anav_ctl(const char *path);
+void log_anav_zygote(int pid);
+void log_anav_shards(int n);
+void log_anav_uring();
+void log_anav_metrics(const char *path, int secs);
+void log_anav_capture(int bytes);
+void log_anav_journal(const char *path, int tasks, int adopted, double ms);
+void log_anav_adopt(int task_num, int pid, int alive);
+void log_anav_tail(int task_num, long long total, long long dropped);
+void log_anav_bench(int task_num, const char *cmd, int runs, int warmup, int par);
+void log_anav_bench_done(int runs, int failed, double secs);
+void log_anav_bench_stat(const char *name, const char *unit, double mean, double sd, double min, double p50, double p95, double p99, double max, int outliers);
+void log_anav_bench_usage();
+void log_anav_top_usage();
+void log_anav_wait_usage();
+void log_anav_wait(int count, int any, double timeout);
+void log_anav_wait_task(int task_num, int status, int exit_code);
+void log_anav_wait_done(int ended, int count, int why);
+void log_anav_meminfo(const char *name, long long blocks, long long bytes, long long peak);
+void log_anav_meminfo_total(long long accounted, long long per_task, long long heap_used, long long heap, long long rss);
+void log_anav_cache(const char *dir, long long max_bytes, long long entries);
+void log_anav_cache_hit(int task_num, const char *cmd, const char *outfile, int exit_code);
+void log_anav_cache_stats(long long hits, long long misses, long long stores, long long evictions, long long entries, long long bytes, long long max_bytes);
+void log_anav_cache_off();
+void log_anav_hedging(double pct);
+void log_anav_hedge(int task_num, int on);
+void log_anav_hedge_launch(int task_num, int pid, double pct, double ms);
+void log_anav_hedge_won(int task_num, int duplicate, int pid, int loser, double ms);
+void log_anav_hedge_reaped(int task_num, int pid, int failed, double ms);
+void log_anav_hedge_stats(double pct, long long launched, long long won, long long lost, long long dropped, double rate);
+void log_anav_hedge_off();
+void log_anav_group(const char *name, int weight, int members);
+void log_anav_groups(int count, int slots);
+void log_anav_group_info(const char *name, int weight, int running, int queued, double cpu, double slot_secs, double share);
+void log_anav_group_queued(int task_num, const char *name, int queued);
+void log_anav_task_queued(int task_num, const char *name);
+void log_anav_orphan(int task_num, int pid);
+void log_anav_task_orphans(int task_num, int orphans);
+void log_anav_task_runtime(int task_num, double predicted, double sd, double runtime, int status);
+void log_anav_group_error(const char *name, const char *why);
+void log_anav_group_usage();
+void log_anav_throttle(int duty);
+void log_anav_predict(const char *path, int models, int order);
+void log_anav_recording(const char *path);
+void log_anav_replay(const char *path, int commands, double speed);
+void log_anav_replay_command(const char *cmd);
+void log_anav_replay_stat(const char *name, const char *unit, double recorded, double replayed);
+void log_anav_replay_done(long long recorded, long long replayed, long long mismatches);
+void log_anav_latency_state(int on);
+void log_anav_latency_phase(const char *phase, long long count, double mean, double p50, double p90, double p99, double p999, double max);
+void log_anav_latency_bar(double low, double high, long long count, int width);
+void log_anav_after(int task_num, const char *deps, int on_success);
+void log_anav_after_cycle(int task_num, int dep);
+void log_anav_dep_failed(int task_num);
+void log_anav_spawn_error(int task_num);
+void log_anav_task_deps(int task_num, const char *deps, int on_success, int waiting);
+
+#endif /*ANAV_LOG_H*/
@@ -0,0 +1,24 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "parse.h"
+
+/* Built-ins added on top of the provided parser's.
+ * - parse() reads after, latency, tail, bench, meminfo, cache, hedge,
+ *   group, top and wait as programs to run. builtin_parse() finishes the
+ *   job as parse() does for its own built-ins: the task number of after,
+ *   tail, bench and hedge, the redirects of after, and argv cleared for
+ *   meminfo and cache. The others keep their tokens in argv.
+ * - A built-in shadows a program of the same name. Typed with a leading
+ *   backslash (\top) the line is added as a task, the backslash dropped.
+ */
+
+/* Completes the Instruction and argv parse() filled in, and strips an
+ * escaping backslash from argv[0] */
+void builtin_parse(Instruction *inst, char *argv[]);
+
+/* Returns the command line as a task keeps it: past an escaping backslash,
+ * or as it is */
+char *builtin_command(char *cmd_line);
+
+#endif /*BUILTINS_H*/
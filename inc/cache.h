@@ -0,0 +1,46 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+/* Content-addressed cache of task results.
+ * - A key hashes a command's argv, the identity of the executable it would
+ *   run (device, inode, size and mtime) and the content of its infile.
+ * - An entry is the outfile the command wrote, kept as DIR/KEY.CODE where
+ *   CODE is the exit code it finished with.
+ * - Outfiles are copied in and out with a reflink where the filesystem
+ *   can, and a plain copy otherwise. Entries are never hardlinked to an
+ *   outfile, since a later run truncating the outfile would change the
+ *   entry with it.
+ * - Past the size bound the least recently used entries are evicted.
+ */
+
+#define CACHE_KEY_LEN 33 /* 32 hex digits and the NUL */
+
+typedef struct cachestats{
+    long long hits;
+    long long misses;
+    long long stores;
+    long long evictions;
+    long long entries;
+    long long bytes;
+    long long max_bytes;
+} CacheStats;
+
+/* Uses dir, created if missing, for at most max_bytes of entries. Returns 0
+ * or -1 on error. */
+int cache_open(const char *dir, long long max_bytes);
+
+/* Fills key for running argv on infile. Returns -1 if the command is not
+ * cacheable: its executable or infile cannot be found or read. */
+int cache_key(char *argv[], const char *infile, char *key);
+
+/* Writes the entry for key to outfile. Returns 1 on a hit, with the
+ * recorded exit code in *exit_code, and 0 on a miss. */
+int cache_restore(const char *key, const char *outfile, int *exit_code);
+
+/* Records outfile as the result of key, finished with exit_code */
+void cache_store(const char *key, const char *outfile, int exit_code);
+
+/* Counters and sizes */
+const CacheStats *cache_stats();
+
+#endif /*CACHE_H*/
@@ -0,0 +1,7 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+/* Read the monotonic clock in nanoseconds. */
+long long now_ns();
+
+#endif /*CLOCK_H*/
@@ -0,0 +1,43 @@
+#ifndef CTL_H
+#define CTL_H
+
+#include <stddef.h>
+#include <poll.h>
+
+/* Control socket: a UNIX-domain stream socket taking batches of commands.
+ * - A request is a 4-byte big-endian length followed by that many bytes of
+ *   newline-separated command lines.
+ * - The reply is framed the same way and holds, for each command line in
+ *   order, any data lines followed by one line starting with "ok" or "err".
+ */
+
+#define CTL_MAX_CLIENTS 64
+#define CTL_MAX_FDS     (CTL_MAX_CLIENTS + 1)
+#define CTL_MAX_FRAME   (64 << 20)
+
+typedef struct reply{
+    char *data;
+    size_t len;
+    size_t cap;
+} Reply;
+
+/* Runs one command line of a request, appending its reply lines to r */
+typedef void (*ctl_command)(const char *line, Reply *r);
+
+/* Appends one formatted line to a reply; does nothing when r is NULL */
+void reply_add(Reply *r, const char *fmt, ...);
+
+/* Listens on path, replacing a stale socket. Returns 0 or -1 on error. */
+int ctl_open(const char *path);
+
+/* Closes every client and removes the socket */
+void ctl_close();
+
+/* Fills fds with what the socket and its clients wait for, returns how many */
+int ctl_fds(struct pollfd *fds, int max);
+
+/* Accepts clients, runs complete requests and sends replies for the fds
+ * filled by ctl_fds() after they have been polled */
+void ctl_service(struct pollfd *fds, int n, ctl_command run);
+
+#endif /*CTL_H*/
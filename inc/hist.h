@@ -0,0 +1,38 @@
+#ifndef HIST_H
+#define HIST_H
+
+/* Log-linear histogram in the style of HdrHistogram.
+ *
+ * Values are bucketed by power of two, and each power of two is split into
+ * HIST_SUB linear sub-buckets, so any recorded value is kept to within about
+ * 3% and recording is a few instructions with no allocation. Values are
+ * non-negative integers, in whatever unit the caller chooses.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_SIZE ((64 - HIST_SUB_BITS) * HIST_SUB)
+
+typedef struct hist{
+    long long count;
+    long long sum;
+    long long min;
+    long long max;
+    long long counts[HIST_SIZE];
+} Hist;
+
+/* Clear all recorded values. */
+void hist_reset(Hist *h);
+
+/* Record one value; negative values are recorded as 0. */
+void hist_record(Hist *h, long long value);
+
+/* Value at or below which the given percentage (0-100) of values fall. */
+long long hist_percentile(const Hist *h, double percent);
+
+/* Mean of the recorded values, 0 if there are none. */
+double hist_mean(const Hist *h);
+
+/* Number of recorded values in [low, high). */
+long long hist_count_range(const Hist *h, long long low, long long high);
+
+#endif /*HIST_H*/
@@ -0,0 +1,58 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Append-only journal of the task table for crash recovery.
+ *
+ * Records go into PATH, a file mapped into memory, so an append is a memcpy
+ * and never a system call on the spawn or reap path. Every so often the live
+ * table is written to PATH.snap (through a temporary file and a rename) and
+ * the journal starts over. Both files carry a generation number, so a crash
+ * between the rename and the reset cannot replay old records twice.
+ *
+ * Nothing is fsync'd: the records outlive a crashed shell, which is what the
+ * journal is for, but not a crashed machine.
+ */
+
+#define JOURNAL_ADD    1 /* task created; strings are the command line then argv */
+#define JOURNAL_STATE  2 /* task started or changed state */
+#define JOURNAL_PURGE  3 /* task removed */
+
+typedef struct jrecord{
+    uint32_t len;      /* whole record padded to 8 bytes, stored last */
+    uint16_t kind;
+    uint16_t argc;     /* NUL-terminated strings following the record */
+    int32_t task_num;
+    int32_t pid;
+    int32_t pgid;
+    int32_t status;
+    int32_t exit_code;
+    int32_t type;
+    int64_t boot_ns;   /* CLOCK_BOOTTIME when the task was started */
+} JRecord;
+
+/* Called for each record found when the journal is opened. */
+typedef void (*journal_fn)(const JRecord *r, const char *strings);
+
+/* Replay the snapshot and journal at path through fn, then keep the journal
+ * open for appending. Returns 0 or -1 on error. */
+int journal_open(const char *path, journal_fn fn);
+
+/* Append a record followed by n bytes of strings. (Signal Handler Safe) */
+void journal_append(const JRecord *r, const char *strings, size_t n);
+
+/* 1 once the journal has outgrown the last snapshot enough to compact it. */
+int journal_should_compact();
+
+/* Write a snapshot: begin, add every live record, end. end swaps it in and
+ * empties the journal. Both return 0 or -1 on error. */
+int journal_snapshot_begin();
+void journal_snapshot_add(const JRecord *r, const char *strings, size_t n);
+int journal_snapshot_end();
+
+/* Unmap and close the journal. */
+void journal_close();
+
+#endif /*JOURNAL_H*/
@@ -0,0 +1,47 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stddef.h>
+
+/* Accounting of the shell's own heap by what it holds.
+ *
+ * Allocation sites report the bytes they ask for as blocks come, grow and
+ * go. That is a few additions per allocation, cheap enough to stay on all
+ * the time; the totals are compared with what the allocator and the kernel
+ * report when meminfo asks.
+ */
+
+#define MEM_TASKS      0 /* Task records */
+#define MEM_TABLE      1 /* the task list array, empty slots included */
+#define MEM_COMMANDS   2 /* command lines and redirect file names */
+#define MEM_ARGV       3 /* argv arrays and their strings */
+#define MEM_DEPS       4 /* dependency lists of after */
+#define MEM_OUTPUT     5 /* captured output rings */
+#define MEM_INDEX      6 /* pid index, watch lists and the poll set */
+#define MEM_BENCH      7 /* bench runs and samples */
+#define MEM_HEDGE      8 /* runtimes of finished runs, kept for hedging */
+#define MEM_CATEGORIES 9
+
+typedef struct memstat{
+    long long blocks;
+    long long bytes;
+    long long peak; /* most bytes held at once */
+} MemStat;
+
+/* A block in cat went from old_size to new_size bytes. An old_size of 0 is a
+ * new block and a new_size of 0 a freed one. */
+void mem_resize(int cat, size_t old_size, size_t new_size);
+
+/* A new block of size bytes in cat */
+void mem_add(int cat, size_t size);
+
+/* A block of size bytes in cat was freed */
+void mem_sub(int cat, size_t size);
+
+/* Counters of cat */
+const MemStat *mem_stat(int cat);
+
+/* Name of cat as meminfo prints it */
+const char *mem_name(int cat);
+
+#endif /*MEMSTAT_H*/
@@ -0,0 +1,49 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <poll.h>
+#include "ctl.h"
+#include "hist.h"
+
+/* OpenMetrics text exporter.
+ * - The shell renders its metrics into a Reply when asked; this module only
+ *   formats samples and delivers the text.
+ * - Over a UNIX-domain socket: a client sends anything (an HTTP GET from
+ *   curl --unix-socket gets an HTTP reply) and is sent the metrics, then the
+ *   connection is closed.
+ * - To a textfile, for node_exporter's textfile collector: rewritten every
+ *   interval through a temporary file and a rename, so readers never see a
+ *   partial file.
+ */
+
+#define METRICS_MAX_CLIENTS 16
+#define METRICS_MAX_FDS     (METRICS_MAX_CLIENTS + 2)
+
+/* Renders every metric into out */
+typedef void (*metrics_render)(Reply *out);
+
+/* Listens on path, replacing a stale socket. Returns 0 or -1 on error. */
+int metrics_open(const char *path);
+
+/* Writes the textfile at path every secs seconds. Returns 0 or -1 on error. */
+int metrics_textfile(const char *path, int secs);
+
+/* Closes the socket and its clients and removes the socket */
+void metrics_close();
+
+/* Fills fds with what the exporter waits for, returns how many */
+int metrics_fds(struct pollfd *fds, int max);
+
+/* Serves clients and writes the textfile for the fds filled by
+ * metrics_fds() after they have been polled */
+void metrics_service(struct pollfd *fds, int n, metrics_render render);
+
+/* Sample formatting. labels is NULL or the text between the braces. */
+void metrics_family(Reply *out, const char *name, const char *type, const char *unit, const char *help);
+void metrics_sample(Reply *out, const char *name, const char *labels, double value);
+
+/* A histogram of nanosecond values, exported in seconds with power-of-two
+ * buckets from 1 us */
+void metrics_hist(Reply *out, const char *name, const char *labels, const Hist *h);
+
+#endif /*METRICS_H*/
@@ -0,0 +1,21 @@
+#ifndef PIDMAP_H
+#define PIDMAP_H
+
+/* Hash map from a child's pid to its task, so a status change is matched to
+ * its task without walking the whole task list.
+ *
+ * Open addressing with linear probing; deleting shifts the rest of the run
+ * back instead of leaving tombstones, so lookups stay short however many
+ * children come and go. The table doubles past half full.
+ */
+
+/* Map pid to v, replacing any earlier value. */
+void pidmap_put(int pid, void *v);
+
+/* Value mapped to pid, NULL if there is none. (Signal Handler Safe) */
+void *pidmap_get(int pid);
+
+/* Forget pid. (Signal Handler Safe) */
+void pidmap_del(int pid);
+
+#endif /*PIDMAP_H*/
@@ -0,0 +1,33 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+/* Runtime prediction from past runs.
+ * - A model is kept per command, keyed by the executable's base name and
+ *   the arguments joined by single spaces, and per executable alone, which
+ *   answers for commands not seen yet.
+ * - A model is an exponentially weighted mean and variance of the runtimes
+ *   of finished runs, so it follows a command whose runtime drifts.
+ * - Models are loaded from a file when opened and written back through a
+ *   temporary file and a rename, as "RUNS MEAN_NS SD_NS KEY" lines.
+ */
+
+#define PREDICT_ALPHA 0.25 /* weight of the newest run */
+
+/* Keeps the models in path, loading any it holds. Without a path they are
+ * kept for this run only. Returns 0 or -1 if the file cannot be read. */
+int predict_open(const char *path);
+
+/* Writes the models back to the file, if there is one */
+void predict_save();
+
+/* Puts the predicted runtime of argv in *mean_ns and its spread in *sd_ns.
+ * Returns 0, or -1 if neither the command nor its executable has run. */
+int predict_get(char *argv[], long long *mean_ns, long long *sd_ns);
+
+/* Adds a finished run of argv that took ns */
+void predict_record(char *argv[], long long ns);
+
+/* Number of models */
+int predict_count();
+
+#endif /*PREDICT_H*/
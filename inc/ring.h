@@ -0,0 +1,34 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+
+/* Byte ring buffer keeping the newest bytes written to it.
+ *
+ * Memory is allocated as output arrives, doubling up to the hard cap given to
+ * ring_init, after which the oldest bytes are overwritten. A task that never
+ * writes costs nothing.
+ */
+typedef struct ring{
+    char *data;
+    size_t cap;   /* most bytes ever kept */
+    size_t size;  /* bytes allocated, at most cap */
+    size_t start; /* offset of the oldest byte */
+    size_t len;   /* bytes kept */
+    long long total; /* bytes ever written */
+} Ring;
+
+/* Set up an empty ring that keeps at most cap bytes. */
+void ring_init(Ring *r, size_t cap);
+
+/* Free the ring's memory. */
+void ring_free(Ring *r);
+
+/* Append bytes, dropping the oldest ones past the cap. */
+void ring_write(Ring *r, const char *buf, size_t n);
+
+/* Copy out the last lines lines kept (a partial last line counts as one).
+ * Returns a malloc'd buffer the caller frees, with its length in *n. */
+char *ring_tail(const Ring *r, int lines, size_t *n);
+
+#endif /*RING_H*/
@@ -0,0 +1,61 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "hist.h"
+
+/* Recording and replay of shell sessions.
+ * - A recording is a text file of one event per line, times in
+ *   microseconds since the shell started:
+ *     c US CMD                        a typed command
+ *     k US CMD                        a control socket command
+ *     s US TASK SPAWN_US              a task started
+ *     x US TASK RUN_US CODE REAP_US   a task ended, CODE is 128 + the
+ *                                     signal for a killed task
+ * - Spawn latency is the command read to the fork returned, reap latency
+ *   the exit taken to the new state logged.
+ * - A loaded recording hands its commands back in order, and its events
+ *   are summed the same way as the live session's, so the two compare
+ *   like for like.
+ */
+
+typedef struct sessionstats{
+    long long first_ns; /* the first command, -1 before any */
+    long long last_ns; /* the last task ended */
+    long long commands;
+    long long starts;
+    long long exits;
+    long long mismatches; /* exit codes that differ from the recording */
+    Hist spawn; /* ns */
+    Hist reap;
+    Hist run;
+} SessionStats;
+
+/* Starts keeping the live session's stats, with times counted from
+ * origin_ns */
+void session_start(long long origin_ns);
+
+/* Writes the live session to path. Returns 0 or -1 on error. */
+int session_record(const char *path);
+
+/* Flushes and closes the recording */
+void session_close();
+
+void session_command(const char *cmd, int from_socket);
+
+void session_started(int task_num, long long spawn_ns);
+
+void session_exited(int task_num, long long run_ns, int code, long long reap_ns);
+
+/* Reads the recording at path for replay. Returns the number of commands,
+ * or -1 if it cannot be read. */
+int session_load(const char *path);
+
+/* Returns the next recorded command, with its time in *ns and whether it
+ * came from the control socket in *from_socket, or NULL after the last. */
+const char *session_next(long long *ns, int *from_socket);
+
+/* What the loaded recording and the live session have seen */
+const SessionStats *session_recorded();
+const SessionStats *session_replayed();
+
+#endif /*SESSION_H*/
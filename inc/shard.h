@@ -0,0 +1,48 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <signal.h>
+#include <sys/resource.h>
+
+/* Supervisor threads that reap children for the shell.
+ * - Each shard thread owns an epoll set of the pidfds handed to it. When one
+ *   turns readable the child has exited, and the thread collects its status
+ *   and rusage with waitid(P_PIDFD, WNOWAIT) and queues them.
+ * - The shell drains every shard's queue in one go when the shared eventfd
+ *   fires, so its bookkeeping still happens on one thread, between polls.
+ *   Each zombie is released once its exit has been applied.
+ * - Only exits are reaped here. Stops and continues still raise SIGCHLD
+ *   and the shell collects them with waitid(WSTOPPED | WCONTINUED).
+ */
+
+#define SHARD_MAX 64
+
+typedef struct shardevent{
+    int pid;
+    int pidfd;
+    int wstatus;      /* as wait4 would have filled it */
+    struct rusage usage;
+    long long ns;     /* CLOCK_MONOTONIC when the exit was collected */
+} ShardEvent;
+
+/* Applies one queued exit */
+typedef void (*shard_fn)(const ShardEvent *e);
+
+/* Starts n supervisor threads. Returns 0 or -1 on error. */
+int shards_start(int n);
+
+/* Hands pidfd, a pidfd of child pid, to a shard. It is closed once the
+ * child is reaped. */
+void shard_watch(int pid, int pidfd);
+
+/* Descriptor readable while exits are queued */
+int shard_fd();
+
+/* Applies every queued exit through fn and reaps the child, returns how
+ * many there were */
+int shards_drain(shard_fn fn);
+
+/* The status word wait4 fills for what waitid reported in info */
+int wstatus_of(const siginfo_t *info);
+
+#endif /*SHARD_H*/
@@ -0,0 +1,56 @@
+#ifndef SHM_TABLE_H
+#define SHM_TABLE_H
+
+#include <stdint.h>
+
+/* Shared-memory task table.
+ *
+ * anav -m SLOTS publishes its task table in /dev/shm/anav.<pid> so other
+ * processes can watch it without talking to the shell. Slot N-1 holds task
+ * N. Each slot is guarded by a sequence counter that is odd while the shell
+ * is writing it: readers copy the slot and retry if the counter was odd or
+ * changed, so neither side ever blocks the other.
+ */
+#define SHM_TABLE_MAGIC   0x414e4156u
+#define SHM_TABLE_VERSION 1
+#define SHM_TABLE_CMD_LEN 64
+
+typedef struct shm_header{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;      /* number of slots */
+    uint32_t entry_size;
+    int32_t shell_pid;
+    uint32_t high_water;    /* highest task number published */
+    uint64_t generation;    /* bumped after every slot update */
+    uint64_t dropped;       /* updates for task numbers beyond capacity */
+    char pad[24];
+} ShmHeader;
+
+typedef struct shm_entry{
+    uint32_t seq;           /* odd while the slot is being written */
+    int32_t task_num;       /* 0 for an empty slot */
+    int32_t pid;
+    int32_t state;          /* LOG_STATE_* */
+    int32_t exit_code;
+    int32_t type;           /* LOG_FG or LOG_BG */
+    int64_t start_ns;       /* CLOCK_MONOTONIC, 0 if never started */
+    int64_t end_ns;         /* CLOCK_MONOTONIC, 0 while not finished */
+    int64_t cpu_us;         /* user + system time of the last finished run */
+    char cmd[SHM_TABLE_CMD_LEN];
+    char pad[16];
+} ShmEntry;
+
+/* Writer side (the shell). shm_table_open returns 0 on success, -1 on failure. */
+int shm_table_open(const char *name, uint32_t capacity);
+void shm_table_publish(const ShmEntry *entry);
+void shm_table_clear(int task_num);
+void shm_table_close();
+
+/* Reader side. shm_table_map maps the table read-only, or returns NULL.
+ * shm_table_read copies a consistent snapshot of one slot; a slot left
+ * half-written by a shell that died reads as empty. */
+const ShmHeader *shm_table_map(const char *name);
+void shm_table_read(const ShmHeader *hdr, uint32_t slot, ShmEntry *out);
+
+#endif /*SHM_TABLE_H*/
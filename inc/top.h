@@ -0,0 +1,51 @@
+#ifndef TOP_H
+#define TOP_H
+
+/* Live sampling of processes for the top view.
+ * - A sampler keeps a process's /proc/PID/stat, statm and io open and
+ *   re-reads them with pread, so a tick costs three reads per process and
+ *   no opens or path lookups.
+ * - Rates are differences between the last two samples.
+ * - The screen remembers the text of every terminal line it drew and only
+ *   rewrites the lines whose text changed since the last frame.
+ */
+
+typedef struct topsample{
+    int pid;
+    int stat_fd;
+    int statm_fd;
+    int io_fd; /* -1 where I/O accounting cannot be read */
+    char state; /* R, S, D, T, Z... as /proc reports it */
+    unsigned long long ticks; /* utime + stime */
+    unsigned long long rchar;
+    unsigned long long wchar;
+    long long rss; /* bytes */
+    long long at; /* CLOCK_MONOTONIC ns of the sample */
+    double cpu_pct;
+    double read_rate; /* bytes per second */
+    double write_rate;
+} TopSample;
+
+/* Opens the files of pid. Returns 0 or -1 if it is gone. */
+int top_open(TopSample *s, int pid);
+
+/* Re-reads the files, taken at now. Returns 0 or -1 if the process is
+ * gone. */
+int top_sample(TopSample *s, long long now);
+
+void top_close(TopSample *s);
+
+/* Clears the terminal for frames of at most rows lines of cols characters */
+void screen_start(int rows, int cols);
+
+/* Sets line row of the frame being drawn */
+void screen_line(int row, const char *text);
+
+/* Blanks the lines below the first used ones and writes the frame out in
+ * one write. Returns the number of lines rewritten. */
+int screen_flush(int used);
+
+/* Leaves the cursor below the last frame */
+void screen_end();
+
+#endif /*TOP_H*/
@@ -0,0 +1,42 @@
+#ifndef URING_H
+#define URING_H
+
+/* io_uring event backend, driven with the raw system calls.
+ * - Each child has a waitid queued on the ring. Its completion only says the
+ *   child has something to report; it is taken with WNOWAIT, so the shell
+ *   still collects the change itself, with its rusage, and a pid is never
+ *   reused before its task has seen the exit.
+ * - Requests are queued without a system call and submitted together by
+ *   uring_submit(), once per event loop pass. Completions are read from the
+ *   mapped queue without one.
+ * - Redirect files can be opened on the ring before a fork.
+ */
+
+/* Applies one change reported for pid. ns is CLOCK_MONOTONIC when the batch
+ * it came in was read. */
+typedef void (*uring_fn)(int pid, long long ns);
+
+/* Sets up a ring with entries submission slots. Returns 0, or -1 if the
+ * kernel cannot run waitid or openat on a ring. */
+int uring_start(unsigned entries);
+
+/* Descriptor readable while completions are waiting */
+int uring_fd();
+
+/* Queues a waitid for the next exit, stop or continue of child pid */
+void uring_watch(int pid);
+
+/* Queues an open of path; *fd is set to the new descriptor, or -1 if the open
+ * fails, once it completes */
+void uring_open(const char *path, int flags, int mode, int *fd);
+
+/* Submits the queued requests and waits until every queued open is done */
+void uring_wait_opens();
+
+/* Submits the queued requests. Returns how many went in, or -1 on error. */
+int uring_submit();
+
+/* Applies every reported change through fn, returns how many there were */
+int uring_drain(uring_fn fn);
+
+#endif /*URING_H*/
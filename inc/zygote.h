@@ -0,0 +1,46 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+/* Zygote: a helper forked while the shell is still small that forks tasks on
+ * its behalf, so the cost of a spawn does not grow with the shell's memory.
+ * - Requests go over a SOCK_SEQPACKET socketpair, the descriptors the child
+ *   needs travel with them as SCM_RIGHTS.
+ * - Children are created with clone3(CLONE_PARENT | CLONE_PIDFD), so the
+ *   shell is their parent: it gets their SIGCHLD and reaps them as before.
+ * - The helper dies with the shell (PR_SET_PDEATHSIG) or when the socket
+ *   is closed.
+ */
+
+#define ZYGOTE_MAX_MSG 65536
+
+/* Everything a child needs to set itself up and exec. A descriptor that is
+ * not needed is -1. */
+typedef struct spawnargs{
+    int task_num;
+    const char *cmd;
+    char **argv;
+    int pgid;      /* process group to join, 0 to lead a new one */
+    int in_fd;     /* replaces stdin */
+    int out_fd;    /* replaces stdout */
+    int unused_fd; /* other end of a pipe, closed in the child */
+    int cap_fd;    /* replaces stdout and stderr for captured output */
+    int status_fd; /* close-on-exec pipe a failed exec is reported on */
+    const char *infile;
+    const char *outfile;
+} SpawnArgs;
+
+/* Sets up and execs the child; never returns */
+typedef void (*zygote_child_fn)(const SpawnArgs *a);
+
+/* Forks the helper, whose children run fn. Returns its pid or -1 on error. */
+int zygote_start(zygote_child_fn fn);
+
+/* Has the helper start a child. Returns its pid, or -1 with errno set if
+ * the helper could not, in which case the caller can fork itself. The
+ * child's pidfd is stored in *pidfd, or closed if pidfd is NULL. */
+int zygote_spawn(const SpawnArgs *a, int *pidfd);
+
+/* Closes the socket, which makes the helper exit */
+void zygote_stop();
+
+#endif /*ZYGOTE_H*/
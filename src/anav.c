@@ -1,16 +1,62 @@
+#define _GNU_SOURCE
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <time.h>
+#include <math.h>
+#include <sys/syscall.h>
 #include "../inc/logging.h"
+#include "../inc/anav_log.h"
 #include "../inc/anav.h"
 #include "../inc/parse.h"
+#include "../inc/builtins.h"
 #include "../inc/util.h"
+#include "../inc/clock.h"
+#include "../inc/hist.h"
+#include "../inc/shm_table.h"
+#include "../inc/ctl.h"
+#include "../inc/ring.h"
+#include "../inc/journal.h"
+#include "../inc/zygote.h"
+#include "../inc/metrics.h"
+#include "../inc/pidmap.h"
+#include "../inc/shard.h"
+#include "../inc/uring.h"
+#include "../inc/memstat.h"
+#include "../inc/cache.h"
+#include "../inc/top.h"
+#include "../inc/session.h"
+#include "../inc/predict.h"
+#include <malloc.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
 
 /* Constants */
+#define HEDGE_MIN_RUNS 5 /* sibling runs needed before a task is hedged */
+#define THROTTLE_IDLE 100 /* -t idle, in place of a duty cycle */
+#define THROTTLE_PERIOD_NS 100000000LL
+#define TASK_ENV "ANAV_TASK" /* tags a task's tree as SHELL_PID:TASK_NUM */
+#define ORDER_FIFO   0 /* -q: group queues in arrival order */
+#define ORDER_SJF    1 /* by predicted runtime */
+#define ORDER_FINISH 2 /* by arrival plus predicted runtime */
 #define DEBUG 0 /* You can set this to 0 to turn off the debug parse information */
 #define STOP_SHELL  0
 #define RUN_SHELL   1
 #define READ_END 0
 #define WRITE_END 1
 
+/* Latency phases, see print_latency() */
+#define LAT_READ_PARSE  0
+#define LAT_PARSE_FORK  1
+#define LAT_FORK_EXEC   2
+#define LAT_READ_EXEC   3
+#define LAT_SIG_CHLD    4
+#define LAT_CHLD_LOG    5
+#define LAT_PHASES      6
+
 typedef struct task{
     int task_num;
     int pid;
@@ -19,11 +65,217 @@ typedef struct task{
     int status;
     int type; /* 0 for foreground and 1 for background */
     int exit_code;
+    int pgid; /* process group shared by every stage of a pipeline */
+    int gang; /* task number of the other pipeline stage, 0 if none */
+    int* deps; /* task numbers that must finish before this task starts */
+    int num_deps;
+    int after_ok; /* 1 if the dependencies must exit with code 0 */
+    int waiting; /* 1 while armed to start once its dependencies resolve */
+    char* infile; /* redirects used when a waiting task is started */
+    char* outfile;
+    long long start_ns; /* monotonic time the task was last started */
+    long long end_ns; /* monotonic time the task last finished */
+    struct rusage usage; /* resources used by the last finished run */
+    long long exec_ns; /* when the exec was seen to succeed, 0 if unknown */
+    long long read_ns; /* when the command that started the run was read, 0 if none was timed */
+    long long signal_ns; /* when the shell last signalled the task, 0 if not pending */
+    int resume_fg; /* 1 if the pending resume brings the task to the foreground */
+    int cap_fd; /* read end of the captured stdout and stderr, -1 if none */
+    Ring out; /* newest captured output */
+    long long boot_ns; /* CLOCK_BOOTTIME at the last start, to recognise the process later */
+    int pidfd; /* pidfd of a task re-adopted from the journal, -1 otherwise */
+    int bench_run; /* 1 for a run started by bench, which is never published */
+    char cache_key[CACHE_KEY_LEN]; /* result cache key of the run in progress, "" if it is not stored */
+    char *run_in; /* redirects of the run in progress, kept while the cache or a hedge needs them */
+    char *run_out;
+    int hedged; /* 1 if the task is idempotent and may be raced by a duplicate */
+    struct task *hedge; /* the duplicate racing the run in progress, NULL if none */
+    int attempt; /* 1 for a duplicate of a hedged task, which is never listed */
+    struct task *primary; /* for a duplicate, the task it races, NULL once it lost */
+    struct group *group; /* group sharing the group slots, NULL if none */
+    int queued; /* 1 while waiting in its group's queue for a slot */
+    struct task *next_queued;
+    int slot; /* 1 while the run in progress holds a group slot */
+    double charged; /* slot seconds charged to the group when the run started */
+    int throttled; /* 1 while held back for a foreground task */
+    int throttle_stops; /* stops and continues throttling sent that are not reported yet */
+    int throttle_conts;
+    long long held_at; /* when throttling last held the task */
+    long long held_ns; /* time the run in progress spent held by throttling before that */
+    int orphans; /* processes of its tree re-parented to the shell and not reaped yet */
+    struct rusage orphan_usage; /* resources of those reaped since the last start */
+    int waited; /* 1 while the wait builtin blocks on it ending */
+    long long predicted_ns; /* runtime the model expected when it was last queued or started, 0 if unknown */
+    long long predicted_sd;
+    long long queue_key; /* place in its group's queue, lowest first */
 } Task;
 
+/* A named set of tasks sharing the group slots by weight. Groups nest by
+ * name, "a/b" inside "a", and hold either tasks or subgroups. */
+typedef struct group{
+    char *name;
+    int weight;
+    struct group *parent; /* the root for a top-level group */
+    int subgroups;
+    int members; /* tasks in the group */
+    Task *head; /* queued tasks, oldest first */
+    Task *tail;
+    int queued; /* tasks queued in the group and below it */
+    int running; /* slots held in the group and below it */
+    double vtime; /* slot seconds received over weight, see group_hold() */
+    double charging; /* slot seconds charged for runs still holding slots */
+    long long finished; /* runs that held a slot and finished */
+    double cpu; /* CPU seconds of those runs */
+    double slot_secs; /* seconds those runs held their slots */
+} Group;
+
+/* Runs of one task's command started by the bench builtin */
+typedef struct bench{
+    Task *runs; /* one slot per parallel run, pid 0 while free */
+    int *seq; /* which run each slot holds, counting warmup runs */
+    int par;
+    int active; /* runs not reaped yet */
+    int started;
+    int warmup; /* runs numbered below this are not measured */
+    int failed; /* measured runs that did not exit with code 0 */
+    int stop; /* set by a keyboard signal, no further run starts */
+    int count; /* measured runs reaped */
+    double *wall; /* per measured run, in ms */
+    double *user;
+    double *sys;
+    double *rss; /* peak resident set size in KiB */
+} Bench;
+
+/* One task sampled by the top builtin */
+typedef struct toprow{
+    int task_num;
+    TopSample s;
+} TopRow;
+
+/* The top builtin in progress */
+typedef struct top{
+    TopRow *rows; /* tasks sampled last tick, in task number order */
+    TopRow *spare; /* where the next tick's rows are built */
+    TopRow **order; /* the rows as shown, busiest first */
+    int count;
+    int size;
+    int on;
+    int stop; /* set by a keyboard signal or a typed line */
+    int redrawn; /* lines the last frame rewrote */
+    long long next; /* when the next tick is due */
+    long long last_ns; /* when the last tick started */
+    double last_cpu; /* the shell's CPU seconds then */
+} Top;
+
+/* The wait builtin in progress. Its tasks are counted off from the reaping
+ * path as they end, so the wait sleeps in event_wait() with nothing to
+ * check between wake-ups but a counter. */
+typedef struct waitset{
+    Task **tasks; /* NULL where a task was purged during the wait */
+    int count;
+    int left; /* tasks that had not ended, counted down as they do */
+    int any; /* 1 if the first task to end ends the wait */
+    int on;
+    int stop; /* set by a keyboard signal */
+    long long due; /* when it times out, 0 for never */
+} WaitSet;
+
+/* Mean, spread and order statistics of a set of samples */
+typedef struct summary{
+    double mean;
+    double sd;
+    double min;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+    int outliers; /* samples beyond 1.5 interquartile ranges of the quartiles */
+} Summary;
+
+/* Runtimes of the finished runs of one program, the siblings a hedged
+ * task running it is measured against */
+typedef struct runtimes{
+    char *prog;
+    Hist ns;
+} Runtimes;
+
+/* Tasks the event loop watches a descriptor of */
+typedef struct watchlist{
+    Task **tasks;
+    int count;
+    int size;
+} WatchList;
+
+/* A child whose exec has not been seen to succeed or fail yet. It is kept
+ * by pid, as the task may be purged or swapped by then. */
+typedef struct pendingexec{
+    int fd; /* read end of the child's status pipe */
+    int pid;
+    long long start_ns;
+} PendingExec;
+
 Task** list = NULL;
 int new_task_num = 1;
-int suspend = 1;
+int list_size = 10;
+int num_tasks = 0;
+Task *fg_task = NULL; /* task the shell waits on, cleared when its state changes */
+Task *fg_resumed = NULL; /* task a resume just brought to the foreground */
+sigset_t shell_mask; /* signals the handler takes, only unblocked inside event_wait() */
+int num_waiting = 0;
+int trace_fd = -1; /* anav_sim workload trace of finished tasks, -1 if not recording */
+int trace_jobs = 0;
+long long shell_start_ns = 0;
+int shell_pid = 0;
+int lat_on = 0; /* latency instrumentation; every timestamp is skipped while off */
+Hist latency[LAT_PHASES];
+int shm_on = 0; /* mirror the task table into shared memory */
+int capture_bytes = 0; /* per-task cap on captured background output, 0 for none */
+WatchList captures = {0}; /* tasks whose output pipe is still open */
+WatchList adopted = {0}; /* running tasks re-adopted from the journal */
+WatchList reparented = {0}; /* tasks a process of whose tree exited since the last adoption pass */
+PendingExec *execs = NULL; /* children whose status pipe is still open */
+int num_execs = 0;
+int execs_size = 0;
+int journal_on = 0; /* record every task change in the journal */
+int zygote_on = 0; /* spawn through the zygote helper */
+int zygote_pid = 0; /* the helper, a child of the shell that belongs to no task */
+Bench bench = {0}; /* the bench builtin in progress, runs is NULL when none is */
+Top top = {0}; /* the top builtin in progress, on is 0 when none is */
+int log_held = -1; /* the terminal's stderr while top holds the log back, -1 otherwise */
+int log_buffer = -1; /* where the log goes meanwhile */
+WaitSet waitset = {0}; /* the wait builtin in progress, on is 0 when none is */
+int shards_on = 0; /* number of shard threads reaping exits, 0 for none */
+int uring_on = 0; /* children are watched through io_uring instead of SIGCHLD */
+int metrics_on = 0; /* an OpenMetrics socket or textfile is being served */
+int cache_on = 0; /* results of tasks with an infile and an outfile are cached */
+int hedge_on = 0; /* hedged tasks are raced by a duplicate once they straggle */
+double hedge_pct = 95; /* percentile of the siblings' runtimes a hedged task may take */
+WatchList hedgeable = {0}; /* running hedged tasks without a duplicate yet */
+Runtimes *runtimes = NULL; /* finished runs by program, with hedging on */
+int num_runtimes = 0;
+long long hedges_launched = 0;
+long long hedge_wins = 0; /* races the duplicate won */
+long long hedge_losses = 0; /* races the original won */
+long long hedges_dropped = 0; /* duplicates that failed, leaving the original running */
+Group root = {"", 1}; /* parent of the top-level groups, counting every slot */
+Group **groups = NULL;
+int num_groups = 0;
+int group_slots = 0; /* tasks of all groups that may run at once */
+int throttle = 0; /* percent of the time background tasks run beside a foreground task, THROTTLE_IDLE for SCHED_IDLE, 0 for off */
+int throttling = 0; /* 1 while a foreground task runs with throttle on */
+int throttle_held = 0; /* 1 in the part of the period background tasks are held */
+long long throttle_next = 0; /* when that part of the period ends */
+int predict_on = 0; /* runtimes are learned per command, with -p or -q */
+int queue_order = ORDER_FIFO;
+int session_on = 0; /* the session is being recorded or replayed */
+long long replay_due = 0; /* when the next replayed command runs, 0 for none waiting */
+long long spawns = 0; /* children started */
+long long spawn_failures = 0; /* failed forks and, with metrics on, failed execs */
+long long signals_sent[NSIG]; /* signals the shell sent to tasks, by number */
+Hist reap_latency; /* SIGCHLD taken to the task's new state logged, with metrics on */
+static const char *state_names[] = {"ready", "running", "suspended", "finished", "killed"};
+static const char *lat_names[] = {"read->parse", "parse->fork", "fork->exec", "read->exec", "signal->sigchld", "sigchld->log"};
+static const int sent_signals[] = {SIGINT, SIGTSTP, SIGSTOP, SIGCONT, SIGKILL, SIGTERM};
 
 void block(){
     sigset_t mask;
@@ -31,10 +283,21 @@ void block(){
     sigprocmask(SIG_BLOCK, &mask, NULL);
 }
 
+/* Returns to the shell's normal mask, where handled signals wait for event_wait() */
 void unblock(){
-    sigset_t mask;
-    sigfillset(&mask);
-    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    sigprocmask(SIG_SETMASK, &shell_mask, NULL);
+}
+
+/* Signals a task's process group and counts it. (Signal Handler Safe) */
+void send_signal(int pgid, int sig){
+    kill(-pgid, sig);
+    signals_sent[sig]++;
+}
+
+/* Signals one process outside its task's process group and counts it */
+void send_signal_pid(int pid, int sig){
+    kill(pid, sig);
+    signals_sent[sig]++;
 }
 
 /* Extracts information from the wstatus filled by waitpid */
@@ -57,383 +320,3333 @@ void extract(int wstatus, int* status, int* transition){
     }
 }
 
-/* Stalls the shell until the foreground process changes status */
-void foreground(){
-    unblock();
-    while (suspend == 1);
+/* Returns the task with the given number, or NULL if there is none */
+Task* get_task(int task_num){
+    if (task_num < 1 || task_num > new_task_num-1) return NULL;
+    return list[task_num-1];
 }
 
-void handler(int sig){
-    int wstatus = 0;
-    int status = 0;
-    int transition = 0;
-    int pid = -1;
+/* Fills a journal record with a task's current state. (Signal Handler Safe) */
+void task_record(Task *t, JRecord *r, int kind){
+    memset(r, 0, sizeof(JRecord));
+    r->kind = kind;
+    r->task_num = t->task_num;
+    r->pid = t->pid;
+    r->pgid = t->pgid;
+    r->status = t->status;
+    r->exit_code = t->exit_code;
+    r->type = t->type;
+    r->boot_ns = t->boot_ns;
+}
+
+/* Packs the command line and argv as NUL-terminated strings into buffer.
+ * Returns the bytes used and sets *argc to the number of strings. */
+size_t task_strings(Task *t, char *buffer, size_t size, uint16_t *argc){
+    size_t len = 0;
+    size_t n = 0;
     int i = 0;
-    int run_exists = 0;
-    block();
-    /* Handles any status change from children */
-    if (sig == SIGCHLD){
-        /* Reap in a loop until there are no more signals to handle */
-        while (1){
-            pid = waitpid(-1, &wstatus, WNOHANG | WUNTRACED | WCONTINUED);
-            for (i=0;i<new_task_num-1;i++){
-                if (list[i] != NULL && list[i]->status == LOG_STATE_RUNNING){
-                    run_exists = 1;
-                }
-            }
-            /* If there are no more signals to handle or if there are no running processes then exit the loop */
-            if (pid == 0 || (pid == -1 && run_exists == 0)){
-                break;
-            }
-            else{
-                /* Handle the signal and update the process' status */
-                extract(wstatus, &status, &transition); 
-                for (i=0;i<new_task_num-1;i++){
-                    if (list[i] != NULL){
-                        if (list[i]->pid == pid){
-                            if (list[i]->type == 0){
-                                suspend = 0;
-                            }
-                            list[i]->status = status;
-                            list[i]->exit_code = WEXITSTATUS(wstatus);
-                            if (transition == LOG_RESUME){
-                                list[i]->type = 0;
-                            }
-                            log_anav_status_change(i+1, pid, list[i]->type, list[i]->cmd, transition);
-                            if (transition == LOG_RESUME){
-                                foreground();
-                            }
-                            run_exists = 0;
-                            break;
-                        }
-                    }
-                }
-            }
+    n = strlen(t->cmd) + 1;
+    memcpy(buffer, t->cmd, n);
+    len = n;
+    *argc = 1;
+    for (i=0;t->argv[i] != NULL;i++){
+        n = strlen(t->argv[i]) + 1;
+        if (len + n > size) break;
+        memcpy(buffer + len, t->argv[i], n);
+        len += n;
+        (*argc)++;
+    }
+    return len;
+}
+
+/* Journals a task's creation */
+void journal_task_add(Task *t){
+    JRecord r;
+    char strings[MAXLINE*2+MAXARGS];
+    size_t n = 0;
+    if (!journal_on) return;
+    task_record(t, &r, JOURNAL_ADD);
+    n = task_strings(t, strings, sizeof(strings), &r.argc);
+    journal_append(&r, strings, n);
+}
+
+/* Rewrites the journal as a snapshot of the live task table */
+void compact(){
+    JRecord r;
+    char strings[MAXLINE*2+MAXARGS];
+    size_t n = 0;
+    int i = 0;
+    if (journal_snapshot_begin() == -1) return;
+    for (i=0;i<new_task_num-1;i++){
+        if (list[i] == NULL) continue;
+        task_record(list[i], &r, JOURNAL_ADD);
+        n = task_strings(list[i], strings, sizeof(strings), &r.argc);
+        journal_snapshot_add(&r, strings, n);
+        task_record(list[i], &r, JOURNAL_STATE);
+        journal_snapshot_add(&r, NULL, 0);
+    }
+    journal_snapshot_end();
+}
+
+/* Mirrors a task into the shared-memory task table and the journal when they
+ * are enabled. (Signal Handler Safe) */
+void publish(Task *t){
+    ShmEntry e;
+    JRecord r;
+    if (t->bench_run || t->attempt) return;
+    if (journal_on){
+        task_record(t, &r, JOURNAL_STATE);
+        journal_append(&r, NULL, 0);
+    }
+    if (!shm_on) return;
+    memset(&e, 0, sizeof(e));
+    e.task_num = t->task_num;
+    e.pid = t->pid;
+    e.state = t->status;
+    e.exit_code = t->exit_code;
+    e.type = t->type;
+    e.start_ns = t->start_ns;
+    e.end_ns = t->end_ns;
+    e.cpu_us = t->usage.ru_utime.tv_sec*1000000LL + t->usage.ru_utime.tv_usec
+             + t->usage.ru_stime.tv_sec*1000000LL + t->usage.ru_stime.tv_usec;
+    strncpy(e.cmd, t->cmd, SHM_TABLE_CMD_LEN-1);
+    shm_table_publish(&e);
+}
+
+/* Reads CLOCK_BOOTTIME, the clock /proc reports process start times in */
+long long boot_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/* Tells the shell through the status pipe that the child will not exec */
+void report_exec_error(int fd){
+    int err = errno;
+    if (fd != -1) write(fd, &err, sizeof(err));
+}
+
+/* Records the spawn phases of a task started by a typed command */
+void lat_spawned(Task *t, long long read_ns, long long parse_ns){
+    if (session_on && read_ns != 0) session_started(t->task_num, now_ns() - read_ns);
+    if (!lat_on || parse_ns == 0) return;
+    hist_record(&latency[LAT_PARSE_FORK], t->start_ns - parse_ns);
+    /* The read to exec phase ends when the exec is seen, see exec_seen() */
+    t->read_ns = read_ns;
+}
+
+/* Prints each phase's percentiles and a histogram over powers of two */
+void print_latency(){
+    int p = 0;
+    int k = 0;
+    long long n = 0;
+    long long most = 0;
+    Hist *h = NULL;
+    log_anav_latency_state(lat_on);
+    for (p=0;p<LAT_PHASES;p++){
+        h = &latency[p];
+        if (h->count == 0) continue;
+        log_anav_latency_phase(lat_names[p], h->count, hist_mean(h)/1e3,
+                               hist_percentile(h, 50)/1e3, hist_percentile(h, 90)/1e3,
+                               hist_percentile(h, 99)/1e3, hist_percentile(h, 99.9)/1e3, h->max/1e3);
+        most = 0;
+        for (k=0;k<62;k++){
+            n = hist_count_range(h, 1LL << k, 1LL << (k+1));
+            if (n > most) most = n;
+        }
+        for (k=0;k<62;k++){
+            n = hist_count_range(h, 1LL << k, 1LL << (k+1));
+            if (n > 0) log_anav_latency_bar((1LL << k)/1e3, (1LL << (k+1))/1e3, n, (int)(n*40/most));
         }
     }
-    /* Handle any keyboard signals */
-    else{
-        for (i=0;i<new_task_num-1;i++){
-            if (list[i] != NULL){
-                if (list[i]->type == 0 && list[i]->status == LOG_STATE_RUNNING){
-                    kill(list[i]->pid, sig);
-                    if (sig == SIGINT) log_anav_ctrl_c();
-                    else if (sig == SIGTSTP) log_anav_ctrl_z();
-                    break;
-                }
-            }
+}
+
+void watch_add(WatchList *w, Task *t){
+    if (w->count == w->size){
+        w->size = w->size ? w->size*2 : 16;
+        w->tasks = realloc(w->tasks, w->size*sizeof(Task*));
+        if (w->tasks == NULL) exit(1);
+        /* The list was full, so count is its old size */
+        mem_resize(MEM_INDEX, w->count*sizeof(Task*), w->size*sizeof(Task*));
+    }
+    w->tasks[w->count++] = t;
+}
+
+void watch_remove(WatchList *w, Task *t){
+    int i = 0;
+    for (i=0;i<w->count;i++){
+        if (w->tasks[i] == t){
+            w->tasks[i] = w->tasks[--w->count];
+            return;
         }
     }
-    unblock();
 }
 
-/* The entry of your text processor program */
-int main() {
-    char *cmd = NULL;
-    int do_run_shell = RUN_SHELL;
-    int num_tasks = 0;
-    int size = 10;
+/* Starts draining the read end of a task's output pipe */
+void add_capture(Task *t, int fd){
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    t->cap_fd = fd;
+    watch_add(&captures, t);
+}
+
+/* Stops draining a task's output pipe and closes it */
+void drop_capture(Task *t){
+    if (t->cap_fd == -1) return;
+    watch_remove(&captures, t);
+    close(t->cap_fd);
+    t->cap_fd = -1;
+}
+
+/* Moves whatever the task wrote into its ring, in large reads and for a
+ * bounded number of them so one chatty task cannot starve the shell */
+void drain_capture(Task *t){
+    char buffer[65536];
+    ssize_t n = 0;
     int i = 0;
+    for (i=0;i<16;i++){
+        n = read(t->cap_fd, buffer, sizeof(buffer));
+        if (n > 0){
+            ring_write(&t->out, buffer, n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) drop_capture(t);
+        break;
+    }
+}
+
+/* Watches a new child's status pipe from the event loop */
+void add_exec(int fd, int pid, long long start_ns){
+    if (num_execs == execs_size){
+        execs_size = execs_size ? execs_size*2 : 16;
+        execs = realloc(execs, execs_size*sizeof(PendingExec));
+        if (execs == NULL) exit(1);
+        mem_resize(MEM_INDEX, num_execs*sizeof(PendingExec), execs_size*sizeof(PendingExec));
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    execs[num_execs++] = (PendingExec){fd, pid, start_ns};
+}
+
+/* Reads the outcome of the i-th pending exec: end of file means the exec
+ * succeeded, an errno that it failed. The last pending exec takes its
+ * place in the list. */
+void exec_seen(int i){
+    PendingExec *e = &execs[i];
+    int err = 0;
+    long long now = now_ns();
+    ssize_t n = read(e->fd, &err, sizeof(err));
     Task *t = NULL;
-    int pid = 0;
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n > 0) spawn_failures++;
+    if (n == 0){
+        if (lat_on) hist_record(&latency[LAT_FORK_EXEC], now - e->start_ns);
+        t = pidmap_get(e->pid);
+        if (t != NULL && t->pid == e->pid){
+            t->exec_ns = now;
+            if (lat_on && t->read_ns != 0) hist_record(&latency[LAT_READ_EXEC], now - t->read_ns);
+        }
+    }
+    close(e->fd);
+    execs[i] = execs[--num_execs];
+}
+
+/* Runs in the new child: joins its process group, sets up its descriptors
+ * and execs. Leaves with _exit, so the shell's atexit handlers stay put. */
+void run_child(const SpawnArgs *a){
+    struct sigaction childsa = {0};
+    sigset_t none;
     char path[MAXLINE+10] = "";
-    int pipefd[2] = {0};
+    char tag[32];
     int fd = 0;
-    struct sigaction sa = {0};
-    struct sigaction childsa = {0};
+    if (a->cap_fd != -1){
+        dup2(a->cap_fd, STDOUT_FILENO);
+        dup2(a->cap_fd, STDERR_FILENO);
+    }
+    setpgid(0, a->pgid);
+    /* Reset signal handlers */
+    childsa.sa_handler = SIG_DFL;
+    sigaction(SIGINT, &childsa, NULL);
+    sigaction(SIGTSTP, &childsa, NULL);
+    sigaction(SIGCHLD, &childsa, NULL);
 
-    list = malloc(size*sizeof(Task*));
-    if (list == NULL) exit(1);
-    for (i=0;i<size;i++){
-        list[i] = malloc(sizeof(Task));
-        if (list[i] == NULL) exit(1);
+    if (a->unused_fd != -1) close(a->unused_fd);
+    if (a->in_fd != -1){
+        dup2(a->in_fd, STDIN_FILENO);
+        close(a->in_fd);
+    }
+    /* Open infile */
+    else if (a->infile != NULL){
+        fd = open(a->infile, O_RDONLY, 0644);
+        if (fd == -1){
+            report_exec_error(a->status_fd);
+            log_anav_file_error(a->task_num, a->infile);
+            _exit(1);
+        }
+        dup2(fd, STDIN_FILENO);
+        log_anav_redir(a->task_num, LOG_REDIR_IN, a->infile);
+    }
+    if (a->out_fd != -1){
+        dup2(a->out_fd, STDOUT_FILENO);
+        close(a->out_fd);
+    }
+    /* Write to outfile */
+    else if (a->outfile != NULL){
+        fd = open(a->outfile, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+        if (fd == -1){
+            report_exec_error(a->status_fd);
+            log_anav_file_error(a->task_num, a->outfile);
+            _exit(1);
+        }
+        dup2(fd, STDOUT_FILENO);
+        log_anav_redir(a->task_num, LOG_REDIR_OUT, a->outfile);
     }
 
-    sa.sa_handler = handler;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTSTP, &sa, NULL);
-    sigaction(SIGCHLD, &sa, NULL);
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
 
-    /* Intial Prompt and Welcome */
-    log_anav_intro();
-    log_anav_help();
+    /* While top holds the shell's log back, the program itself still
+     * writes to the terminal */
+    if (log_held != -1 && a->cap_fd == -1) dup2(log_held, STDERR_FILENO);
 
-  /* Shell looping here to accept user command and execute */
-    while (do_run_shell == RUN_SHELL) {
-        char *argv[MAXARGS+1] = {0};  /* Argument list */
-        Instruction inst = {0};       /* Instruction structure: check parse.h */
+    /* Tag the tree, whose processes inherit the environment, so its orphans
+     * are known by adopt_orphan() wherever they moved */
+    snprintf(tag, sizeof(tag), "%d:%d", shell_pid, a->task_num);
+    setenv(TASK_ENV, tag, 1);
 
-        /* Print prompt */
-        log_anav_prompt();
+    /* Attempt to exec with both paths */
+    strncpy(path, "./", MAXLINE+10);
+    strncat(path, (a->argv)[0], MAXLINE); 
+    execv(path, a->argv);
 
-        /* Get Input - Allocates memory for the cmd copy */
-        cmd = get_input(); 
-        /* If the input is whitespace/invalid, get new input from the user. */
-        if(cmd == NULL) {
-          continue;
-        }
+    strncpy(path, "/usr/bin/", MAXLINE+10);
+    strncat(path, (a->argv)[0], MAXLINE); 
+    execv(path, a->argv);
 
-        /* Check to see if this is the quit built-in */
-        if(strncmp(cmd, "quit", 4) == 0) {
-          /* This is a match, so we'll set the main loop to exit when you finish processing it */
-          do_run_shell = STOP_SHELL;
-          /* Note: You will need to print a message when quit is entered, 
-           *       you can do it here, in your functions, or at the end of main.
-           */
-          log_anav_quit();
-          continue;
-        }
+    if (log_held != -1 && a->cap_fd == -1) dup2(log_buffer, STDERR_FILENO);
+    report_exec_error(a->status_fd);
+    log_anav_exec_error(a->cmd);
+    _exit(1);
+}
 
-        if (strncmp(cmd, "help", 4) == 0){
-            log_anav_help();
-            continue;
-        }
+/* Sets the runtime the model expects of the task, 0 if it knows nothing */
+void predict_task(Task *t){
+    t->predicted_ns = t->predicted_sd = 0;
+    if (predict_on && predict_get(t->argv, &t->predicted_ns, &t->predicted_sd) == -1) t->predicted_ns = t->predicted_sd = 0;
+}
 
-        if (strncmp(cmd, "list", 4) == 0){
-            block();
-            log_anav_num_tasks(num_tasks);
-            for (i=0;i<new_task_num-1;i++){
-                if (list[i] != NULL){
-                    t = list[i];
-                    log_anav_task_info(t->task_num, t->status, t->exit_code, t->pid, t->cmd);
-                }
-            }
-            unblock();
-            continue;
+/* Starts a child running the task's command in process group pgid, or in a
+ * new group led by the child when pgid is 0. in_fd and out_fd replace stdin
+ * and stdout when not -1, otherwise infile and outfile are opened if given.
+ * unused_fd (the other end of a pipe) is closed in the child.
+ * With capture on, a background task whose stdout is not redirected writes
+ * stdout and stderr into a pipe the shell drains.
+ * With the zygote on, the helper forks the child, and the shell forks it
+ * itself only if the helper fails.
+ * With instrumentation or metrics on, whether the exec succeeded is learnt
+ * later in event_wait(), so a child that blocks before its exec (on a FIFO
+ * given as infile, say) does not hold up the shell.
+ * Signals must already be blocked by the caller. */
+int spawn(Task *t, int pgid, int in_fd, int out_fd, int unused_fd, const char *infile, const char *outfile){
+    int pid = -1;
+    int pidfd = -1;
+    int in_file = -1;
+    int out_file = -1;
+    long long start_ns = 0;
+    /* With instrumentation or metrics on, the child reports a failed exec
+     * through a close-on-exec pipe, so end of file means the exec succeeded */
+    int status_pipe[2] = {-1, -1};
+    int cap_pipe[2] = {-1, -1};
+    SpawnArgs a = {t->task_num, t->cmd, t->argv, pgid, in_fd, out_fd, unused_fd, -1, -1, infile, outfile};
+    if ((lat_on || metrics_on) && pipe2(status_pipe, O_CLOEXEC) == -1){
+        status_pipe[READ_END] = status_pipe[WRITE_END] = -1;
+    }
+    if (capture_bytes > 0 && t->type == 1 && out_fd == -1 && outfile == NULL){
+        if (pipe2(cap_pipe, O_CLOEXEC) == -1) cap_pipe[READ_END] = cap_pipe[WRITE_END] = -1;
+    }
+    a.cap_fd = cap_pipe[WRITE_END];
+    a.status_fd = status_pipe[WRITE_END];
+    /* With io_uring on, redirect files are opened on the ring before the
+     * fork. A file that fails to open is left to the child, which reports it
+     * as it always has. */
+    if (uring_on && in_fd == -1 && infile != NULL) uring_open(infile, O_RDONLY, 0644, &in_file);
+    if (uring_on && out_fd == -1 && outfile != NULL) uring_open(outfile, O_WRONLY | O_TRUNC | O_CREAT, 0644, &out_file);
+    if (uring_on && (infile != NULL || outfile != NULL)) uring_wait_opens();
+    if (in_file != -1){
+        a.in_fd = in_file;
+        log_anav_redir(t->task_num, LOG_REDIR_IN, infile);
+    }
+    if (out_file != -1){
+        a.out_fd = out_file;
+        log_anav_redir(t->task_num, LOG_REDIR_OUT, outfile);
+    }
+    /* Taken before the fork, as a shard thread may reap a quick child before
+     * the fork returns here */
+    start_ns = now_ns();
+    if (zygote_on) pid = zygote_spawn(&a, shards_on ? &pidfd : NULL);
+    if (pid == -1) pid = fork();
+    if (pid == 0){
+        if (status_pipe[READ_END] != -1) close(status_pipe[READ_END]);
+        run_child(&a);
+    }
+    if (pid == -1) spawn_failures++;
+    if (in_file != -1) close(in_file);
+    if (out_file != -1) close(out_file);
+    if (pid > 0){
+        spawns++;
+        /* Set the group from the parent as well, so a signal sent to the
+         * gang right away cannot miss a child that has not run yet */
+        if (pgid == 0) pgid = pid;
+        setpgid(pid, pgid);
+        if (!t->bench_run){
+            if (t->pid != 0 && pidmap_get(t->pid) == t) pidmap_del(t->pid);
+            pidmap_put(pid, t);
         }
+        /* With shards on, the exit is reaped through the child's pidfd */
+        if (shards_on && pidfd == -1) pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (shards_on && pidfd != -1) shard_watch(pid, pidfd);
+        if (uring_on) uring_watch(pid);
+        t->pid = pid;
+        t->pgid = pgid;
+        memset(&t->orphan_usage, 0, sizeof(struct rusage));
+        t->start_ns = start_ns;
+        t->end_ns = 0;
+        t->held_ns = 0;
+        if (!t->bench_run && !t->attempt) predict_task(t);
+        t->exec_ns = t->read_ns = 0;
+        t->boot_ns = boot_ns();
+        publish(t);
+    }
+    if (cap_pipe[READ_END] != -1){
+        close(cap_pipe[WRITE_END]);
+        /* Output left from an earlier run stays in the ring, the old pipe goes */
+        drop_capture(t);
+        if (pid > 0) add_capture(t, cap_pipe[READ_END]);
+        else close(cap_pipe[READ_END]);
+    }
+    if (status_pipe[READ_END] != -1){
+        close(status_pipe[WRITE_END]);
+        if (pid > 0) add_exec(status_pipe[READ_END], pid, start_ns);
+        else close(status_pipe[READ_END]);
+    }
+    return pid;
+}
 
-        /* Parse the Command and Populate the Instruction and Arguments */
-        initialize_command(&inst, argv);    /* initialize arg lists and instruction */
-        parse(cmd, &inst, argv);            /* call provided parse() */
+void account_string(int cat, const char *s, int freed);
 
-        if (DEBUG) {  /* display parse result, redefine DEBUG to turn it off */
-          debug_print_parse(cmd, &inst, argv, "main (after parse)");
-        }
+/* Keeps copies of the redirects a run was started with */
+void keep_redirects(Task *t, const char *infile, const char *outfile){
+    t->run_in = infile ? string_copy(infile) : NULL;
+    t->run_out = outfile ? string_copy(outfile) : NULL;
+    account_string(MEM_COMMANDS, t->run_in, 0);
+    account_string(MEM_COMMANDS, t->run_out, 0);
+}
 
-        /*.===============================================.
-         *| Add your code below this line to continue. 
-         *| - The command has been parsed and you have cmd, inst, and argv filled with data.
-         *| - Very highly recommended to start calling your own functions after this point.
-         *o===============================================*/
+void drop_redirects(Task *t){
+    account_string(MEM_COMMANDS, t->run_in, 1);
+    account_string(MEM_COMMANDS, t->run_out, 1);
+    free(t->run_in);
+    free(t->run_out);
+    t->run_in = t->run_out = NULL;
+}
 
-        if (strncmp(inst.instruct, "purge", 5) == 0){
-            block();
-            if (inst.id1 <= new_task_num-1) t = list[inst.id1-1];
-            if (inst.id1 > new_task_num-1 || list[inst.id1-1] == NULL){
-                log_anav_task_num_error(inst.id1);
-            }
-            else if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
-                log_anav_status_error(t->task_num, t->status);
-            }
-            else{
-                free(t->cmd);
-                free_argv(t->argv); 
-                free(t);
-                list[inst.id1-1] = NULL; 
-                num_tasks--;
-                log_anav_purge(inst.id1);
+/* Counts a task of the wait in progress off once it has ended or can no
+ * longer start. (Signal Handler Safe) */
+void wait_resolved(Task *t){
+    if (!t->waited) return;
+    t->waited = 0;
+    waitset.left--;
+}
+
+/* Drops a task being purged from the wait in progress */
+void wait_forget(Task *t){
+    int i = 0;
+    wait_resolved(t);
+    for (i=0;i<waitset.count;i++){
+        if (waitset.tasks[i] == t) waitset.tasks[i] = NULL;
+    }
+}
+
+/* Readies a task's run with the given redirects. With the cache on, a task
+ * with both an infile and an outfile is looked up first: on a hit the
+ * outfile is restored and the task finishes with the recorded exit code,
+ * without a child, and 1 is returned. On a miss the key is kept so the
+ * result is stored when the run exits. */
+int prepare_run(Task *t, const char *infile, const char *outfile){
+    int exit_code = 0;
+    drop_redirects(t);
+    t->cache_key[0] = '\0';
+    if (cache_on && infile != NULL && outfile != NULL && cache_key(t->argv, infile, t->cache_key) == 0
+        && cache_restore(t->cache_key, outfile, &exit_code)){
+        t->cache_key[0] = '\0';
+        t->pid = 0;
+        t->status = LOG_STATE_FINISHED;
+        t->exit_code = exit_code;
+        t->start_ns = t->end_ns = now_ns();
+        t->exec_ns = 0;
+        memset(&t->usage, 0, sizeof(t->usage));
+        publish(t);
+        wait_resolved(t);
+        log_anav_cache_hit(t->task_num, t->cmd, outfile, exit_code);
+        return 1;
+    }
+    /* The result is stored from the outfile, a duplicate reads the infile
+     * and a queued task is started with both */
+    if (t->cache_key[0] != '\0' || (hedge_on && t->hedged) || t->group != NULL) keep_redirects(t, infile, outfile);
+    return 0;
+}
+
+/* Puts a task that just started where hedge_check() looks for stragglers,
+ * if it is hedged. Only background runs are raced. */
+void hedge_arm(Task *t){
+    if (hedge_on && t->hedged && t->type == 1 && t->pid > 0) watch_add(&hedgeable, t);
+}
+
+/* Returns 1 if name is a group path: segments joined by '/', none empty */
+int group_name_ok(const char *name){
+    return name[0] != '\0' && name[0] != '/' && name[strlen(name)-1] != '/' && strstr(name, "//") == NULL
+        && strcmp(name, "weight") != 0;
+}
+
+/* Returns the group called name, or NULL if there is none. With create set
+ * it and any group above it are made, with weight 1, unless one above holds
+ * tasks. */
+Group *group_get(const char *name, int create){
+    char parent[MAXLINE];
+    char *slash = NULL;
+    Group *p = &root;
+    Group *g = NULL;
+    int i = 0;
+    for (i=0;i<num_groups;i++){
+        if (strcmp(groups[i]->name, name) == 0) return groups[i];
+    }
+    if (!create) return NULL;
+    snprintf(parent, sizeof(parent), "%s", name);
+    slash = strrchr(parent, '/');
+    if (slash != NULL){
+        *slash = '\0';
+        p = group_get(parent, 1);
+        if (p == NULL) return NULL;
+    }
+    if (p->members > 0) return NULL;
+    g = calloc(1, sizeof(Group));
+    groups = realloc(groups, (num_groups+1)*sizeof(Group*));
+    if (g == NULL || groups == NULL) exit(1);
+    mem_resize(MEM_INDEX, num_groups*sizeof(Group*), (num_groups+1)*sizeof(Group*));
+    mem_add(MEM_TASKS, sizeof(Group));
+    g->name = string_copy(name);
+    account_string(MEM_COMMANDS, g->name, 0);
+    g->weight = 1;
+    g->parent = p;
+    p->subgroups++;
+    groups[num_groups++] = g;
+    return g;
+}
+
+/* Virtual time of a group up to the start of its runs in progress */
+double group_vstart(const Group *g){
+    return g->vtime - g->charging / g->weight;
+}
+
+/* A group that had nothing queued or running starts from the least virtual
+ * time its busy siblings have been served to, so time spent idle is not
+ * banked as credit */
+void group_wake(Group *g){
+    Group *least = NULL;
+    int i = 0;
+    for (i=0;i<num_groups;i++){
+        if (groups[i] == g || groups[i]->parent != g->parent) continue;
+        if (groups[i]->queued == 0 && groups[i]->running == 0) continue;
+        if (least == NULL || group_vstart(groups[i]) < group_vstart(least)) least = groups[i];
+    }
+    if (least != NULL && group_vstart(least) > g->vtime) g->vtime = group_vstart(least);
+}
+
+/* Puts a task in its group's queue: at the back, or with -q ahead of the
+ * tasks predicted to run longer (sjf) or to finish later if started on
+ * arrival (finish). Tasks the model knows nothing of go first, so it
+ * learns them. */
+void group_enqueue(Task *t){
+    Group *g = NULL;
+    Task *prev = NULL;
+    Task *q = NULL;
+    for (g=t->group;g!=&root;g=g->parent){
+        if (g->queued == 0 && g->running == 0) group_wake(g);
+    }
+    g = t->group;
+    predict_task(t);
+    t->queue_key = queue_order == ORDER_FINISH ? now_ns() + t->predicted_ns : t->predicted_ns;
+    /* Behind every task with a key as low, so equal keys keep their order */
+    if (queue_order == ORDER_FIFO) prev = g->tail;
+    else{
+        for (q=g->head;q!=NULL && q->queue_key<=t->queue_key;q=q->next_queued) prev = q;
+    }
+    t->next_queued = prev != NULL ? prev->next_queued : g->head;
+    if (prev != NULL) prev->next_queued = t;
+    else g->head = t;
+    if (t->next_queued == NULL) g->tail = t;
+    t->queued = 1;
+    for (;g!=NULL;g=g->parent) g->queued++;
+    log_anav_group_queued(t->task_num, t->group->name, t->group->queued);
+}
+
+/* Takes a task out of its group's queue, wherever it is in it */
+void group_dequeue(Task *t){
+    Group *g = t->group;
+    Task *prev = NULL;
+    Task *q = g->head;
+    while (q != t){
+        prev = q;
+        q = q->next_queued;
+    }
+    if (prev != NULL) prev->next_queued = t->next_queued;
+    else g->head = t->next_queued;
+    if (g->tail == t) g->tail = prev;
+    t->next_queued = NULL;
+    t->queued = 0;
+    for (;g!=NULL;g=g->parent) g->queued--;
+}
+
+/* Gives t a slot of its group. This is start-time fair queueing: each group
+ * from t's up is charged the slot seconds the run is expected to hold, the
+ * mean of its group's finished runs, over the group's weight, and
+ * group_release() corrects the charge once the run is over. */
+void group_hold(Task *t){
+    Group *g = t->group;
+    t->charged = g->finished ? g->slot_secs / g->finished : 1.0;
+    t->slot = 1;
+    for (;g!=NULL;g=g->parent){
+        g->running++;
+        g->charging += t->charged;
+        g->vtime += t->charged / g->weight;
+    }
+}
+
+/* Returns t's slot to its group once the run finished at end_ns */
+void group_release(Task *t, long long end_ns, const struct rusage *usage){
+    double held = (end_ns - t->start_ns) / 1e9;
+    double cpu = usage->ru_utime.tv_sec + usage->ru_utime.tv_usec/1e6 + usage->ru_stime.tv_sec + usage->ru_stime.tv_usec/1e6;
+    Group *g = t->group;
+    t->slot = 0;
+    for (;g!=NULL;g=g->parent){
+        g->running--;
+        g->charging -= t->charged;
+        g->vtime += (held - t->charged) / g->weight;
+        g->finished++;
+        g->cpu += cpu;
+        g->slot_secs += held;
+    }
+}
+
+/* Takes back the slot group_hold() gave to a run that never started */
+void group_unhold(Task *t){
+    Group *g = t->group;
+    t->slot = 0;
+    for (;g!=NULL;g=g->parent){
+        g->running--;
+        g->charging -= t->charged;
+        g->vtime -= t->charged / g->weight;
+    }
+}
+
+/* Puts a task no child could be forked for back to ready, returning any
+ * group slot it was given */
+void start_failed(Task *t){
+    if (t->slot) group_unhold(t);
+    t->status = LOG_STATE_READY;
+    publish(t);
+    wait_resolved(t);
+    log_anav_spawn_error(t->task_num);
+}
+
+/* Moves a task that is not running into group g, keeping its place in line
+ * if it was queued */
+void group_join(Task *t, Group *g){
+    int queued = t->queued;
+    if (queued) group_dequeue(t);
+    if (t->group != NULL) t->group->members--;
+    t->group = g;
+    g->members++;
+    if (queued) group_enqueue(t);
+}
+
+/* Starts queued tasks while group slots are free. From the root down, the
+ * busy subgroup furthest behind in virtual time is served first. */
+void group_dispatch(){
+    Group *g = NULL;
+    Group *best = NULL;
+    Task *t = NULL;
+    int i = 0;
+    while (root.queued > 0 && root.running < group_slots){
+        for (g=&root;g->head==NULL;g=best){
+            best = NULL;
+            for (i=0;i<num_groups;i++){
+                if (groups[i]->parent != g || groups[i]->queued == 0) continue;
+                if (best == NULL || groups[i]->vtime < best->vtime) best = groups[i];
             }
-            unblock();
+        }
+        t = g->head;
+        group_dequeue(t);
+        group_hold(t);
+        t->status = LOG_STATE_RUNNING;
+        if (spawn(t, 0, -1, -1, -1, t->run_in, t->run_out) == -1){
+            start_failed(t);
             continue;
         }
+        hedge_arm(t);
+        log_anav_status_change(t->task_num, t->pid, LOG_BG, t->cmd, LOG_START);
+    }
+}
 
-        if (strncmp(inst.instruct, "exec", 4) == 0 || strncmp(inst.instruct, "bg", 2) == 0 || strncmp(inst.instruct, "pipe", 4) == 0){
-            if (inst.id1 <= new_task_num-1) t = list[inst.id1-1];
-            if (inst.id1 > new_task_num-1 || t == NULL){
-                log_anav_task_num_error(inst.id1);
-                continue;
-            }
-            else if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
-                log_anav_status_error(t->task_num, t->status);
-            }
-            else{
-                /* Set the type to background */
-                if (strncmp(inst.instruct, "bg", 2) == 0 || strncmp(inst.instruct, "pipe", 4) == 0){
-                    t->type = 1;
-                }
-                if (strncmp(inst.instruct, "pipe", 4) == 0){
-                    if (inst.id1 == inst.id2){
-                        log_anav_pipe_error(inst.id1);
-                        continue;
-                    }
-                    if (pipe(pipefd) == -1){
-                        log_anav_file_error(inst.id1, LOG_FILE_PIPE);
-                        continue;
-                    }
-                    log_anav_pipe(inst.id1, inst.id2);
-                }
-                block();
-                t->status = LOG_STATE_RUNNING;
-                /* First child */
-                pid = fork(); 
-                if (pid == 0){
-                    setpgid(0,0);
-                    /* Reset signal handlers */
-                    childsa.sa_handler = SIG_DFL;
-                    sigaction(SIGINT, &childsa, NULL);
-                    sigaction(SIGTSTP, &childsa, NULL);
-                    sigaction(SIGCHLD, &childsa, NULL);
-
-                    /* Create pipe */
-                    if (strncmp(inst.instruct, "pipe", 4) == 0){
-                        close(pipefd[READ_END]);
-                        dup2(pipefd[WRITE_END], STDOUT_FILENO);
-                    }
-                    else{
-                        /* Open infile */
-                        if (inst.infile != NULL){
-                            fd = open(inst.infile, O_RDONLY, 0644);
-                            if (fd == -1){
-                                log_anav_file_error(t->task_num, inst.infile);
-                                exit(1);
-                            }
-                            dup2(fd, STDIN_FILENO);
-                            log_anav_redir(t->task_num, LOG_REDIR_IN, inst.infile);
-                        }
-                        /* Write to infile */
-                        if (inst.outfile != NULL){
-                            fd = open(inst.outfile, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-                            if (fd == -1){
-                                log_anav_file_error(t->task_num, inst.outfile);
-                                exit(1);
-                            }
-                            dup2(fd, STDOUT_FILENO);
-                            log_anav_redir(t->task_num, LOG_REDIR_OUT, inst.outfile);
-                        }
-                    }
-
-                    unblock();
-
-                    /* Attempt to exec with both paths */
-                    strncpy(path, "./", MAXLINE+10);
-                    strncat(path, (t->argv)[0], MAXLINE); 
-                    execv(path, t->argv);
-
-                    strncpy(path, "/usr/bin/", MAXLINE+10);
-                    strncat(path, (t->argv)[0], MAXLINE); 
-                    execv(path, t->argv);
-
-                    log_anav_exec_error(t->cmd);
-                    exit(1);
-                }
-                else{
-                    t->pid = pid;
-                    if (strncmp(inst.instruct, "pipe", 4) == 0){
-                        t->status = LOG_STATE_RUNNING;
-                        log_anav_status_change(t->task_num, t->pid, LOG_BG, t->cmd, LOG_START);
-
-                        if (inst.id2 <= new_task_num-1) t = list[inst.id2-1];
-                        if (inst.id2 > new_task_num-1 || t == NULL){
-                            log_anav_task_num_error(inst.id2);
-                        }
-                        else if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
-                            log_anav_status_error(t->task_num, t->status);
-                        }
-                        else{
-                            block();
-                            /* Second child */
-                            pid = fork();
-                            if (pid == 0){
-                                setpgid(0,0);
-                                childsa.sa_handler = SIG_DFL;
-                                sigaction(SIGINT, &childsa, NULL);
-                                sigaction(SIGTSTP, &childsa, NULL);
-                                sigaction(SIGCHLD, &childsa, NULL);
-
-                                close(pipefd[WRITE_END]);
-                                dup2(pipefd[READ_END], STDIN_FILENO);
-
-                                unblock();
-
-                                strncpy(path, "./", MAXLINE+10);
-                                strncat(path, (t->argv)[0], MAXLINE); 
-                                execv(path, t->argv);
-
-                                strncpy(path, "/usr/bin/", MAXLINE+10);
-                                strncat(path, (t->argv)[0], MAXLINE); 
-                                execv(path, t->argv);
-
-                                log_anav_exec_error(cmd);
-                                exit(1);
-                            }
-                            else{
-                                t->pid = pid;
-                                close(pipefd[0]);
-                                close(pipefd[1]);
-                                log_anav_status_change(t->task_num, t->pid, LOG_FG, t->cmd, LOG_START);
-                                /* Stall until foreground process is updated */
-                                foreground();
-                            }
-                        }
-                    }
-                    else if (strncmp(inst.instruct, "exec", 4) == 0){
-                        log_anav_status_change(t->task_num, t->pid, LOG_FG, t->cmd, LOG_START);
-                        /* Stall until foreground process is updated */
-                        foreground();
-                    }
-                    else{
-                        log_anav_status_change(t->task_num, t->pid, LOG_BG, t->cmd, LOG_START);
-                        unblock();
-                    }
-                }
-            }
-            continue;
+/* Starts a task in the background. Returns 1 if it finished at once from a
+ * cached result. */
+int start_bg(Task *t, const char *infile, const char *outfile){
+    t->type = 1;
+    t->gang = 0;
+    if (prepare_run(t, infile, outfile)) return 1;
+    if (t->group != NULL){
+        group_enqueue(t);
+        return 0;
+    }
+    t->status = LOG_STATE_RUNNING;
+    if (spawn(t, 0, -1, -1, -1, infile, outfile) == -1){
+        start_failed(t);
+        return 0;
+    }
+    hedge_arm(t);
+    log_anav_status_change(t->task_num, t->pid, LOG_BG, t->cmd, LOG_START);
+    return 0;
+}
+
+/* Returns 1 once every dependency of the task has finished (with exit code 0
+ * if required), -1 if one never can, and 0 while it is still waiting */
+int deps_state(Task *t){
+    int i = 0;
+    int ready = 1;
+    Task *d = NULL;
+    for (i=0;i<t->num_deps;i++){
+        d = get_task(t->deps[i]);
+        if (d == NULL) return -1;
+        if (d->status == LOG_STATE_FINISHED){
+            if (t->after_ok && d->exit_code != 0) return -1;
+        }
+        else if (d->status == LOG_STATE_KILLED){
+            if (t->after_ok) return -1;
+        }
+        else{
+            ready = 0;
         }
+    }
+    return ready;
+}
 
-        if (strncmp(inst.instruct, "kill", 4) == 0 || strncmp(inst.instruct, "suspend", 7) == 0 || strncmp(inst.instruct, "resume", 6) == 0){
-            if (inst.id1 <= new_task_num-1) t = list[inst.id1-1];
-            if (inst.id1 > new_task_num-1 || t == NULL){
-                log_anav_task_num_error(inst.id1);
-            }
-            else if (t->status == LOG_STATE_READY || t->status == LOG_STATE_FINISHED || t->status == LOG_STATE_KILLED){
-                log_anav_status_error(t->task_num, t->status);
-            }
-            else{
-                if (strncmp(inst.instruct, "kill", 4) == 0){
-                    kill(t->pid, SIGINT);
-                    log_anav_sig_sent(LOG_CMD_KILL, t->task_num, pid);
-                }
-                else if (strncmp(inst.instruct, "suspend", 7) == 0){
-                    kill(t->pid, SIGTSTP);
-                    log_anav_sig_sent(LOG_CMD_SUSPEND, t->task_num, pid);
-                }
-                else if (strncmp(inst.instruct, "resume", 6) == 0){
-                    kill(t->pid, SIGCONT);
-                    log_anav_sig_sent(LOG_CMD_RESUME, t->task_num, pid);
-                }
-            }
-            continue;
+/* Starts every waiting task whose dependencies have all resolved, and
+ * queued tasks of groups while group slots are free.
+ * Called from the reaping path, so it must run with signals blocked. */
+void adopt_orphans();
+
+void start_dependents(){
+    int i = 0;
+    int state = 0;
+    int cached = 0;
+    Task *t = NULL;
+    adopt_orphans();
+    group_dispatch();
+    if (num_waiting == 0) return;
+    for (i=0;i<new_task_num-1;i++){
+        t = list[i];
+        if (t == NULL || !t->waiting) continue;
+        state = deps_state(t);
+        if (state == 0) continue;
+        t->waiting = 0;
+        num_waiting--;
+        if (state < 0){
+            log_anav_dep_failed(t->task_num);
+            wait_resolved(t);
+        }
+        else cached |= start_bg(t, t->infile, t->outfile);
+    }
+    group_dispatch();
+    /* A task finished from the cache may release others in turn */
+    if (cached) start_dependents();
+}
+
+/* Returns 1 if target is reachable from task number from by following dependencies */
+int reaches(int from, int target){
+    int *stack = NULL;
+    char *seen = NULL;
+    int top = 0;
+    int found = 0;
+    int i = 0;
+    int n = 0;
+    Task *d = NULL;
+    stack = malloc((new_task_num+1)*sizeof(int));
+    seen = calloc(new_task_num+1, 1);
+    if (stack == NULL || seen == NULL) exit(1);
+    stack[top++] = from;
+    seen[from] = 1;
+    while (top > 0 && !found){
+        n = stack[--top];
+        if (n == target){
+            found = 1;
+            break;
         }
-        
-        /* Create task and add it to the list */
-        block();
-        Task task = {new_task_num, 0, string_copy(cmd), clone_argv(argv), LOG_STATE_READY, 0, 0};
-        log_anav_task_init(task.task_num, task.cmd);
-        /* Double the size of the list if it is full */
-        if (new_task_num-1 == size){
-            size *= 2;
-            list = realloc(list, (size)*(sizeof(Task*)));
-            if (list == NULL) exit(1);
-            for (i=size/2;i<size;i++){
-                list[i] = malloc(sizeof(Task));
-                if (list[i] == NULL) exit(1);
+        d = get_task(n);
+        if (d == NULL) continue;
+        for (i=0;i<d->num_deps;i++){
+            if (!seen[d->deps[i]]){
+                seen[d->deps[i]] = 1;
+                stack[top++] = d->deps[i];
             }
         }
-        *list[task.task_num-1] = task;
-        num_tasks++;
-        new_task_num++;
-        unblock();
+    }
+    free(stack);
+    free(seen);
+    return found;
+}
 
-        
+/* Formats a list of task numbers as "#1 #2 ..." */
+void format_deps(char *buffer, int size, int *deps, int num_deps){
+    int i = 0;
+    int len = 0;
+    buffer[0] = '\0';
+    for (i=0;i<num_deps && len < size;i++){
+        len += snprintf(buffer+len, size-len, i == 0 ? "#%d" : " #%d", deps[i]);
+    }
+}
+
+/* Appends a finished task's run to the workload trace as
+ * "ID ARRIVAL CPU IO PRIORITY" in milliseconds, where IO is the part of the
+ * wall time the task spent off the CPU. (Signal Handler Safe) */
+void trace_task(Task *t){
+    char buffer[128] = "";
+    long long cpu_us = t->usage.ru_utime.tv_sec*1000000LL + t->usage.ru_utime.tv_usec
+                     + t->usage.ru_stime.tv_sec*1000000LL + t->usage.ru_stime.tv_usec;
+    long long wall_us = (t->end_ns - t->start_ns) / 1000;
+    long long io_us = wall_us > cpu_us ? wall_us - cpu_us : 0;
+    int len = 0;
+    if (trace_fd == -1) return;
+    len = snprintf(buffer, sizeof(buffer), "%d %.3f %.3f %.3f 0\n", ++trace_jobs,
+                   (t->start_ns - shell_start_ns) / 1e6, cpu_us / 1e3, io_us / 1e3);
+    write(trace_fd, buffer, len);
+}
 
+void socket_command(const char *line, Reply *r);
+Task* new_task(int task_num, const char *cmd, char **argv);
+void free_task(Task *t);
 
-        /*.===============================================.
-         *| After your code: We cleanup before Looping to the next command.
-         *| free_command WILL free the cmd, inst and argv data.
-         *| Make sure you've copied any needed information to your Task first.
-         *| Hint: You can use the util.c functions for copying this information.
-         *o===============================================*/
-        free_command(cmd, &inst, argv);
+/* Marks a re-adopted task finished once its pidfd reports the exit. The shell
+ * is not its parent, so the exit code is not visible and is left as -1. */
+void adopted_exited(Task *t){
+    watch_remove(&adopted, t);
+    close(t->pidfd);
+    t->pidfd = -1;
+    t->status = LOG_STATE_FINISHED;
+    t->exit_code = -1;
+    t->end_ns = now_ns();
+    publish(t);
+    wait_resolved(t);
+    log_anav_status_change(t->task_num, t->pid, t->type, t->cmd, LOG_TERM);
+    start_dependents();
+}
+
+/* Takes back a task that was running when the previous shell died. Returns 1
+ * if its pid still names the process it started, which is checked after
+ * pidfd_open has pinned the pid so it cannot be reused in between. */
+int adopt(Task *t){
+    char path[64] = "";
+    char buffer[1024] = "";
+    char state = 0;
+    unsigned long long ticks = 0;
+    long long start_ns = 0;
+    char *p = NULL;
+    int n = 0;
+    int fd = -1;
+    int stat_fd = -1;
+    if (t->pid <= 0 || t->boot_ns == 0) return 0;
+    fd = syscall(SYS_pidfd_open, t->pid, 0);
+    if (fd == -1) return 0;
+    snprintf(path, sizeof(path), "/proc/%d/stat", t->pid);
+    stat_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (stat_fd != -1){
+        n = read(stat_fd, buffer, sizeof(buffer) - 1);
+        close(stat_fd);
+    }
+    /* Fields after the command name: state is the 3rd and starttime the 22nd */
+    p = n > 0 ? strrchr(buffer, ')') : NULL;
+    if (p == NULL || sscanf(p + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+                            &state, &ticks) != 2){
+        close(fd);
+        return 0;
+    }
+    start_ns = (long long)(ticks * (1000000000.0 / sysconf(_SC_CLK_TCK)));
+    if (state == 'Z' || llabs(start_ns - t->boot_ns) > 1000000000LL){
+        close(fd);
+        return 0;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    t->pidfd = fd;
+    t->type = 1;
+    watch_add(&adopted, t);
+    return 1;
+}
+
+/* Applies one journal record to the task table being rebuilt */
+void restore_record(const JRecord *r, const char *strings){
+    char *argv[MAXARGS+1] = {0};
+    const char *cmd = strings;
+    Task *t = get_task(r->task_num);
+    int i = 0;
+    if (r->kind == JOURNAL_ADD && t == NULL && r->task_num > 0 && r->argc > 0){
+        strings += strlen(strings) + 1;
+        for (i=0;i<r->argc-1 && i<MAXARGS;i++){
+            argv[i] = (char*)strings;
+            strings += strlen(strings) + 1;
+        }
+        new_task(r->task_num, cmd, argv);
+    }
+    else if (r->kind == JOURNAL_STATE && t != NULL){
+        t->pid = r->pid;
+        t->pgid = r->pgid;
+        t->status = r->status;
+        t->exit_code = r->exit_code;
+        t->type = r->type;
+        t->boot_ns = r->boot_ns;
+    }
+    else if (r->kind == JOURNAL_PURGE && t != NULL){
+        free_task(t);
+    }
+}
+
+/* Rebuilds the task table from the journal at path and re-adopts the tasks
+ * that survived the previous shell */
+void restore(const char *path){
+    long long start = now_ns();
+    int i = 0;
+    int alive = 0;
+    Task *t = NULL;
+    if (journal_open(path, restore_record) == -1){
+        log_anav_open_error(path);
+        exit(1);
+    }
+    if (shm_on){
+        for (i=0;i<new_task_num-1;i++){
+            if (list[i] != NULL) publish(list[i]);
+        }
+    }
+    /* Appends pick up where the replayed journal ended */
+    journal_on = 1;
+    for (i=0;i<new_task_num-1;i++){
+        t = list[i];
+        if (t == NULL) continue;
+        if (t->status != LOG_STATE_RUNNING && t->status != LOG_STATE_SUSPENDED) continue;
+        if (adopt(t)){
+            alive++;
+            log_anav_adopt(t->task_num, t->pid, 1);
+        }
+        else{
+            t->status = LOG_STATE_KILLED;
+            t->exit_code = -1;
+            log_anav_adopt(t->task_num, t->pid, 0);
+        }
+        publish(t);
+    }
+    log_anav_journal(path, num_tasks, alive, (now_ns() - start) / 1e6);
+}
+
+/* Reads a running process's CPU time, with that of the children it has
+ * waited for, and its resident set size from /proc. Returns 0 or -1 if it
+ * is gone. */
+int proc_usage(int pid, double *cpu_s, double *rss_bytes){
+    char path[64];
+    char buf[1024];
+    char *p = NULL;
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    long cutime = 0;
+    long cstime = 0;
+    long rss = 0;
+    int fd = -1;
+    ssize_t n = 0;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    /* Fields after the command name, which may hold spaces: state is field 3,
+     * utime 14, stime 15, cutime 16, cstime 17 and rss 24 */
+    p = strrchr(buf, ')');
+    if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld %*d %*d %*d %*d %*u %*u %ld",
+                            &utime, &stime, &cutime, &cstime, &rss) != 5) return -1;
+    *cpu_s = (double)(utime + stime + cutime + cstime) / sysconf(_SC_CLK_TCK);
+    *rss_bytes = (double)rss * sysconf(_SC_PAGESIZE);
+    return 0;
+}
+
+/* Calls fn on each child of pid, as listed by each of its threads, and with
+ * deep set on their children in turn, parents before their children */
+void each_child(int pid, int deep, void (*fn)(int pid, void *arg), void *arg){
+    char path[320];
+    struct dirent *e = NULL;
+    DIR *d = NULL;
+    FILE *f = NULL;
+    int child = 0;
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    d = opendir(path);
+    if (d == NULL) return;
+    while ((e = readdir(d)) != NULL){
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "/proc/%d/task/%s/children", pid, e->d_name);
+        f = fopen(path, "r");
+        if (f == NULL) continue;
+        while (fscanf(f, "%d", &child) == 1){
+            fn(child, arg);
+            if (deep) each_child(child, deep, fn, arg);
+        }
+        fclose(f);
+    }
+    closedir(d);
+}
+
+/* Adds the CPU time and resident set size of a live process of a tree */
+void add_proc_usage(int pid, void *arg){
+    double *sum = arg;
+    double cpu = 0;
+    double rss = 0;
+    if (proc_usage(pid, &cpu, &rss) == -1) return;
+    sum[0] += cpu;
+    sum[1] += rss;
+}
+
+/* Adds the orphans of the task in arg[0] and their descendants */
+void add_orphan_usage(int pid, void *arg){
+    void **a = arg;
+    if (pid == ((Task*)a[0])->pid || pidmap_get(pid) != a[0]) return;
+    add_proc_usage(pid, a[1]);
+    each_child(pid, 1, add_proc_usage, a[1]);
+}
+
+/* Sums the CPU time and resident set size of a task's whole process tree:
+ * the task's process, every live descendant, its orphans and the orphans
+ * already reaped. A finished task's own process counts its peak RSS.
+ * Returns 0 or -1 if the task has no process to account. */
+int task_usage(Task *t, double *cpu_s, double *rss_bytes){
+    double sum[2] = {0, 0};
+    void *a[2] = {t, sum};
+    if (t->pid == 0) return -1;
+    if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
+        if (proc_usage(t->pid, &sum[0], &sum[1]) == -1) return -1;
+        if (t->pidfd == -1) each_child(t->pid, 1, add_proc_usage, sum);
+    }
+    else{
+        sum[0] = t->usage.ru_utime.tv_sec + t->usage.ru_utime.tv_usec/1e6
+               + t->usage.ru_stime.tv_sec + t->usage.ru_stime.tv_usec/1e6;
+        sum[1] = t->usage.ru_maxrss * 1024.0;
+    }
+    if (t->orphans > 0) each_child(getpid(), 0, add_orphan_usage, a);
+    sum[0] += t->orphan_usage.ru_utime.tv_sec + t->orphan_usage.ru_utime.tv_usec/1e6
+            + t->orphan_usage.ru_stime.tv_sec + t->orphan_usage.ru_stime.tv_usec/1e6;
+    *cpu_s = sum[0];
+    *rss_bytes = sum[1];
+    return 0;
+}
+
+/* Sends the signal in arg[1] to a descendant that left the process group
+ * in arg[0], which the signal to the group missed */
+void signal_stray(int pid, void *arg){
+    int *a = arg;
+    if (getpgid(pid) != a[0]) send_signal_pid(pid, a[1]);
+}
+
+/* Sends the signal in arg[1] to the orphans of the task in arg[0] and to
+ * their descendants that left the process group in arg[1] */
+void signal_orphan(int pid, void *arg){
+    void **a = arg;
+    Task *t = a[0];
+    if (pid == t->pid || pidmap_get(pid) != t) return;
+    signal_stray(pid, a[1]);
+    each_child(pid, 1, signal_stray, a[1]);
+}
+
+/* Signals a task's whole process tree: its process group, which holds every
+ * process that stayed in it, then each descendant and orphan that left it.
+ * Those are no longer part of the job, and may sit in an orphaned group
+ * where the kernel drops SIGTSTP or have SIGINT ignored as background
+ * commands of a script do, so they are stopped with SIGSTOP and killed with
+ * SIGTERM instead. Once the task's own process is reaped its group may be
+ * gone and its number reused, so only its orphans, unreaped children of the
+ * shell whose pids cannot be reused, are signalled, each one as a stray. */
+void signal_tree(Task *t, int sig){
+    int live = (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED);
+    int stray[2] = {live ? t->pgid : 0, sig == SIGTSTP ? SIGSTOP : sig == SIGINT ? SIGTERM : sig};
+    void *a[2] = {t, stray};
+    if (live) send_signal(t->pgid, sig);
+    if (live && t->pidfd == -1) each_child(t->pid, 1, signal_stray, stray);
+    if (t->orphans > 0) each_child(getpid(), 0, signal_orphan, a);
+}
+
+/* Returns the task of this shell whose tag a process inherited, see
+ * run_child(), or NULL if it has none: it cleared its environment, came
+ * from another shell, or its task was purged */
+Task *tagged_task(int pid){
+    char path[64];
+    char *entry = NULL;
+    size_t size = 0;
+    int shell = 0;
+    int num = 0;
+    Task *t = NULL;
+    FILE *f = NULL;
+    snprintf(path, sizeof(path), "/proc/%d/environ", pid);
+    f = fopen(path, "r");
+    if (f == NULL) return NULL;
+    while (t == NULL && getdelim(&entry, &size, '\0', f) != -1){
+        if (sscanf(entry, TASK_ENV "=%d:%d", &shell, &num) == 2 && shell == shell_pid) t = get_task(num);
+    }
+    free(entry);
+    fclose(f);
+    return t;
+}
+
+/* Gives a child of the shell that no task started to the task whose tree it
+ * came from, known by the tag it inherited. It holds through setpgid(),
+ * setsid() and the exit of any process between the orphan and the task.
+ * Without a tag it is a guess: the one of the tasks that just lost a
+ * process sharing the orphan's process group, or else the first of them,
+ * wrong when the orphan left its group while several trees lost a process
+ * in the pass. */
+void adopt_orphan(int pid, void *arg){
+    Task *t = NULL;
+    int pgid = 0;
+    int pidfd = -1;
+    int i = 0;
+    if (pid == zygote_pid || pidmap_get(pid) != NULL) return;
+    for (i=0;i<bench.par;i++){
+        if (bench.runs[i].pid == pid) return;
+    }
+    t = tagged_task(pid);
+    if (t == NULL){
+        t = reparented.tasks[0];
+        pgid = getpgid(pid);
+        for (i=0;i<reparented.count;i++){
+            if (reparented.tasks[i]->pgid == pgid) t = reparented.tasks[i];
+        }
+    }
+    pidmap_put(pid, t);
+    t->orphans++;
+    /* Reaped like the task's own process in every mode */
+    if (shards_on && (pidfd = syscall(SYS_pidfd_open, pid, 0)) != -1) shard_watch(pid, pidfd);
+    if (uring_on) uring_watch(pid);
+    log_anav_orphan(t->task_num, pid);
+}
+
+/* The shell is the subreaper of every task, so a process whose parent exits
+ * is re-parented to it. After a pass in which processes of task trees
+ * exited, every child the shell does not know yet is an orphan of some
+ * task tree. The exit of a process the shell did not start is not seen, so
+ * its children wait for the next pass to be adopted. */
+void adopt_orphans(){
+    if (reparented.count == 0) return;
+    each_child(getpid(), 0, adopt_orphan, NULL);
+    reparented.count = 0;
+}
+
+void add_time(struct timeval *sum, const struct timeval *t){
+    sum->tv_sec += t->tv_sec + (sum->tv_usec + t->tv_usec) / 1000000;
+    sum->tv_usec = (sum->tv_usec + t->tv_usec) % 1000000;
+}
+
+/* Adds the resources of a reaped orphan of t's tree to the task, whose own
+ * children are orphans of the same tree now. (Signal Handler Safe) */
+void orphan_reaped(Task *t, const struct rusage *usage){
+    add_time(&t->orphan_usage.ru_utime, &usage->ru_utime);
+    add_time(&t->orphan_usage.ru_stime, &usage->ru_stime);
+    watch_add(&reparented, t);
+}
+
+/* Accounts the exit of an orphan of t. Its stops and continues change
+ * nothing for the task. (Signal Handler Safe) */
+void orphan_changed(Task *t, int pid, int wstatus, const struct rusage *usage){
+    if (!WIFEXITED(wstatus) && !WIFSIGNALED(wstatus)) return;
+    pidmap_del(pid);
+    t->orphans--;
+    orphan_reaped(t, usage);
+}
+
+/* Renders the shell's metrics in OpenMetrics text format */
+void render_metrics(Reply *out){
+    char labels[64];
+    long long states[5] = {0};
+    const CacheStats *cs = cache_stats();
+    double cpu = 0;
+    double rss = 0;
+    int i = 0;
+    Task *t = NULL;
+    for (i=0;i<new_task_num-1;i++){
+        if (list[i] != NULL) states[list[i]->status]++;
+    }
+    metrics_family(out, "anav_tasks", "gauge", NULL, "Tasks in the list by state.");
+    for (i=0;i<5;i++){
+        snprintf(labels, sizeof(labels), "state=\"%s\"", state_names[i]);
+        metrics_sample(out, "anav_tasks", labels, states[i]);
+    }
+    metrics_family(out, "anav_spawns", "counter", NULL, "Children started.");
+    metrics_sample(out, "anav_spawns_total", NULL, spawns);
+    metrics_family(out, "anav_spawn_failures", "counter", NULL, "Children that could not be forked or could not exec.");
+    metrics_sample(out, "anav_spawn_failures_total", NULL, spawn_failures);
+    metrics_family(out, "anav_signals_sent", "counter", NULL, "Signals sent to task process groups.");
+    for (i=0;i<(int)(sizeof(sent_signals)/sizeof(int));i++){
+        snprintf(labels, sizeof(labels), "signal=\"SIG%s\"", sigabbrev_np(sent_signals[i]));
+        metrics_sample(out, "anav_signals_sent_total", labels, signals_sent[sent_signals[i]]);
+    }
+    metrics_family(out, "anav_reap_latency_seconds", "histogram", "seconds", "SIGCHLD taken to the task's new state logged.");
+    metrics_hist(out, "anav_reap_latency_seconds", NULL, &reap_latency);
+    if (lat_on){
+        metrics_family(out, "anav_latency_seconds", "histogram", "seconds", "Latency instrumentation phases.");
+        for (i=0;i<LAT_PHASES;i++){
+            snprintf(labels, sizeof(labels), "phase=\"%s\"", lat_names[i]);
+            metrics_hist(out, "anav_latency_seconds", labels, &latency[i]);
+        }
+    }
+    if (cache_on){
+        metrics_family(out, "anav_cache_lookups", "counter", NULL, "Result cache lookups by outcome.");
+        metrics_sample(out, "anav_cache_lookups_total", "result=\"hit\"", cs->hits);
+        metrics_sample(out, "anav_cache_lookups_total", "result=\"miss\"", cs->misses);
+        metrics_family(out, "anav_cache_evictions", "counter", NULL, "Result cache entries evicted to stay under the size bound.");
+        metrics_sample(out, "anav_cache_evictions_total", NULL, cs->evictions);
+        metrics_family(out, "anav_cache_bytes", "gauge", "bytes", "Bytes held by result cache entries.");
+        metrics_sample(out, "anav_cache_bytes", NULL, cs->bytes);
+    }
+    if (hedge_on){
+        metrics_family(out, "anav_hedges", "counter", NULL, "Duplicates started to race straggling hedged tasks, by outcome.");
+        metrics_sample(out, "anav_hedges_total", "outcome=\"won\"", hedge_wins);
+        metrics_sample(out, "anav_hedges_total", "outcome=\"lost\"", hedge_losses);
+        metrics_sample(out, "anav_hedges_total", "outcome=\"dropped\"", hedges_dropped);
+    }
+    if (num_groups > 0){
+        metrics_family(out, "anav_group_running", "gauge", NULL, "Group slots held, subgroups included.");
+        for (i=0;i<num_groups;i++){
+            snprintf(labels, sizeof(labels), "group=\"%.50s\"", groups[i]->name);
+            metrics_sample(out, "anav_group_running", labels, groups[i]->running);
+        }
+        metrics_family(out, "anav_group_queued", "gauge", NULL, "Tasks waiting for a group slot, subgroups included.");
+        for (i=0;i<num_groups;i++){
+            snprintf(labels, sizeof(labels), "group=\"%.50s\"", groups[i]->name);
+            metrics_sample(out, "anav_group_queued", labels, groups[i]->queued);
+        }
+        metrics_family(out, "anav_group_cpu_seconds", "counter", "seconds", "CPU time of a group's finished runs.");
+        for (i=0;i<num_groups;i++){
+            snprintf(labels, sizeof(labels), "group=\"%.50s\"", groups[i]->name);
+            metrics_sample(out, "anav_group_cpu_seconds_total", labels, groups[i]->cpu);
+        }
+        metrics_family(out, "anav_group_slot_seconds", "counter", "seconds", "Time a group's finished runs held their slots.");
+        for (i=0;i<num_groups;i++){
+            snprintf(labels, sizeof(labels), "group=\"%.50s\"", groups[i]->name);
+            metrics_sample(out, "anav_group_slot_seconds_total", labels, groups[i]->slot_secs);
+        }
+    }
+    /* Running tasks are read from /proc, finished ones from their rusage */
+    metrics_family(out, "anav_task_cpu_seconds", "gauge", "seconds", "User and system CPU time of a task's last run, across its process tree.");
+    for (i=0;i<new_task_num-1;i++){
+        t = list[i];
+        if (t == NULL || task_usage(t, &cpu, &rss) == -1) continue;
+        snprintf(labels, sizeof(labels), "task=\"%d\"", t->task_num);
+        metrics_sample(out, "anav_task_cpu_seconds", labels, cpu);
+    }
+    metrics_family(out, "anav_task_rss_bytes", "gauge", "bytes", "Resident set size of a task's process tree, with its own process at its peak once it has finished.");
+    for (i=0;i<new_task_num-1;i++){
+        t = list[i];
+        if (t == NULL || task_usage(t, &cpu, &rss) == -1) continue;
+        snprintf(labels, sizeof(labels), "task=\"%d\"", t->task_num);
+        metrics_sample(out, "anav_task_rss_bytes", labels, rss);
+    }
+    reply_add(out, "# EOF");
+}
+
+/* Runtimes of the finished runs of prog, created empty the first time */
+Hist *runtimes_of(const char *prog){
+    int i = 0;
+    for (i=0;i<num_runtimes;i++){
+        if (strcmp(runtimes[i].prog, prog) == 0) return &runtimes[i].ns;
+    }
+    runtimes = realloc(runtimes, (num_runtimes+1)*sizeof(Runtimes));
+    if (runtimes == NULL) exit(1);
+    mem_resize(MEM_HEDGE, num_runtimes*sizeof(Runtimes), (num_runtimes+1)*sizeof(Runtimes));
+    runtimes[num_runtimes].prog = string_copy(prog);
+    account_string(MEM_HEDGE, prog, 0);
+    hist_reset(&runtimes[num_runtimes].ns);
+    return &runtimes[num_runtimes++].ns;
+}
+
+/* How long the run in progress of a task has run by now, leaving out the
+ * time throttling held it, when it made no progress */
+long long run_ns(Task *t, long long now){
+    long long held = t->held_ns;
+    if (t->throttled) held += now - t->held_at;
+    return now - t->start_ns - held;
+}
+
+/* Where the duplicate of a hedged task writes its outfile until it wins */
+void hedge_outfile(Task *t, char *path, size_t size){
+    snprintf(path, size, "%s.hedge", t->run_out);
+}
+
+/* Starts a duplicate of a straggling hedged task to race it. The duplicate
+ * shares the task's command line and infile, writes its outfile aside, and
+ * with capture on its output is discarded, as the ring stays the task's.
+ * The duplicate borrows the task's cmd and argv rather than owning copies,
+ * so it is never put in list and never goes through free_task(): its record
+ * alone is freed, here or in hedge_changed(). */
+void hedge_launch(Task *t, long long elapsed_ns){
+    char out[MAXLINE+16];
+    int null_out = -1;
+    int pid = -1;
+    Task *d = malloc(sizeof(Task));
+    if (d == NULL) exit(1);
+    mem_add(MEM_TASKS, sizeof(Task));
+    *d = *t;
+    d->attempt = 1;
+    d->primary = t;
+    d->hedge = NULL;
+    d->pid = 0;
+    d->cap_fd = -1;
+    d->pidfd = -1;
+    d->run_in = d->run_out = NULL;
+    d->cache_key[0] = '\0';
+    d->group = NULL;
+    d->slot = 0;
+    d->orphans = 0;
+    ring_init(&d->out, 0);
+    if (t->run_out != NULL) hedge_outfile(t, out, sizeof(out));
+    else if (capture_bytes > 0) null_out = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    pid = spawn(d, 0, -1, null_out, -1, t->run_in, t->run_out ? out : NULL);
+    if (null_out != -1) close(null_out);
+    if (pid == -1){
+        mem_sub(MEM_TASKS, sizeof(Task));
+        free(d);
+        return;
+    }
+    t->hedge = d;
+    hedges_launched++;
+    log_anav_hedge_launch(t->task_num, d->pid, hedge_pct, elapsed_ns / 1e6);
+}
+
+/* Races a duplicate against every hedged task that has run longer than
+ * hedge_pct of its program's finished runs. Returns when the next one falls
+ * due, or 0 if none can until more runs finish. */
+long long hedge_check(){
+    long long now = now_ns();
+    long long next = 0;
+    long long due = 0;
+    Hist *h = NULL;
+    Task *t = NULL;
+    int i = 0;
+    for (i=hedgeable.count-1;i>=0;i--){
+        t = hedgeable.tasks[i];
+        h = runtimes_of(t->argv[0]);
+        /* A suspended task is not straggling, nor one throttling holds; its
+         * time comes again once throttling lets it go */
+        if (h->count < HEDGE_MIN_RUNS || t->status != LOG_STATE_RUNNING || t->throttled) continue;
+        due = now - run_ns(t, now) + hist_percentile(h, hedge_pct);
+        if (due <= now){
+            watch_remove(&hedgeable, t);
+            hedge_launch(t, run_ns(t, now));
+        }
+        else if (next == 0 || due < next){
+            next = due;
+        }
+    }
+    return next;
+}
+
+/* Settles the race of a hedged task when one of its attempts changes state.
+ * a is the owner of pid in the index: the task, its racing duplicate, or a
+ * duplicate that lost. The first attempt to exit wins and the other is
+ * killed; the duplicate wins only by exiting with code 0, so a failed one is
+ * dropped and the original keeps running. Returns the task the change
+ * applies to, or NULL if it only concerned a duplicate.
+ * (Signal Handler Safe) */
+Task *hedge_changed(Task *a, int pid, int wstatus, long long recv_ns){
+    char out[MAXLINE+16];
+    Task *t = a->primary;
+    Task *d = a->hedge;
+    int exited = WIFEXITED(wstatus) || WIFSIGNALED(wstatus);
+    int lost_pid = 0;
+    int lost_pgid = 0;
+    long long lost_start = 0;
+    if (!a->attempt){
+        /* The original finished first */
+        if (exited){
+            a->hedge = NULL;
+            d->primary = NULL;
+            send_signal(d->pgid, SIGKILL);
+            if (a->run_out != NULL){
+                hedge_outfile(a, out, sizeof(out));
+                unlink(out);
+            }
+            hedge_losses++;
+            log_anav_hedge_won(a->task_num, 0, pid, d->pid, (recv_ns - a->start_ns) / 1e6);
+        }
+        return a;
+    }
+    /* A duplicate's stops and continues are not followed */
+    if (!exited) return NULL;
+    if (t == NULL || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0){
+        if (t != NULL){
+            t->hedge = NULL;
+            if (t->run_out != NULL){
+                hedge_outfile(t, out, sizeof(out));
+                unlink(out);
+            }
+            hedges_dropped++;
+        }
+        log_anav_hedge_reaped(a->task_num, pid, t != NULL, (recv_ns - a->start_ns) / 1e6);
+        pidmap_del(pid);
+        mem_sub(MEM_TASKS, sizeof(Task));
+        free(a);
+        return NULL;
+    }
+    /* The duplicate won. It takes the task's place, and the original, now
+     * the loser, is collected through the duplicate's record. */
+    t->hedge = NULL;
+    send_signal(t->pgid, SIGKILL);
+    hedge_wins++;
+    log_anav_hedge_won(t->task_num, 1, pid, t->pid, (recv_ns - t->start_ns) / 1e6);
+    if (t->run_out != NULL){
+        hedge_outfile(t, out, sizeof(out));
+        rename(out, t->run_out);
+    }
+    lost_pid = t->pid;
+    lost_pgid = t->pgid;
+    lost_start = t->start_ns;
+    pidmap_del(lost_pid);
+    pidmap_del(pid);
+    pidmap_put(lost_pid, a);
+    pidmap_put(pid, t);
+    t->pid = pid;
+    t->pgid = a->pgid;
+    t->start_ns = a->start_ns;
+    t->exec_ns = a->exec_ns;
+    /* Duplicates are never held, and the held original is gone */
+    t->throttled = 0;
+    t->held_ns = 0;
+    a->pid = lost_pid;
+    a->pgid = lost_pgid;
+    a->start_ns = lost_start;
+    a->primary = NULL;
+    return t;
+}
+
+/* Moves every thread of process pid to a scheduling policy */
+void set_policy(int pid, int policy){
+    char path[64];
+    struct sched_param sp = {0};
+    struct dirent *e = NULL;
+    DIR *d = NULL;
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    d = opendir(path);
+    if (d == NULL) return;
+    while ((e = readdir(d)) != NULL){
+        if (e->d_name[0] != '.') sched_setscheduler(atoi(e->d_name), policy, &sp);
+    }
+    closedir(d);
+}
+
+/* Lets a task held by throttling go, leaving the time it was held out of
+ * its run_ns() */
+void throttle_unhold(Task *t){
+    t->held_ns += now_ns() - t->held_at;
+    t->throttled = 0;
+}
+
+/* Holds every running background task back, or lets every held one go.
+ * Held tasks are stopped, or with -t idle moved to SCHED_IDLE, whose
+ * threads only run when nothing else wants the CPU. A task sharing the
+ * foreground task's process group, its pipeline, is never held. Each
+ * stop and continue sent is expected back once through child_changed(),
+ * which drops it. */
+void throttle_apply(int hold){
+    Task *t = NULL;
+    int i = 0;
+    for (i=0;i<new_task_num-1;i++){
+        t = list[i];
+        if (t == NULL) continue;
+        if (hold && !t->throttled && t->status == LOG_STATE_RUNNING && t->pid > 0 && t->pidfd == -1
+            && (fg_task == NULL || t->pgid != fg_task->pgid)){
+            if (throttle == THROTTLE_IDLE) set_policy(t->pid, SCHED_IDLE);
+            else{
+                send_signal(t->pgid, SIGSTOP);
+                t->throttle_stops++;
+            }
+            t->throttled = 1;
+            t->held_at = now_ns();
+        }
+        else if (!hold && t->throttled){
+            if (throttle == THROTTLE_IDLE) set_policy(t->pid, SCHED_OTHER);
+            else{
+                send_signal(t->pgid, SIGCONT);
+                t->throttle_conts++;
+            }
+            throttle_unhold(t);
+        }
+    }
+}
+
+/* Hands a task held by a duty cycle, and every stage of its pipeline, back
+ * to the user before signalling it. Its group is stopped already, so a
+ * SIGTSTP would stay pending with no change reported, and be cleared by
+ * the continue at release: the suspend is recorded here instead, and the
+ * tasks are left out of the release. Any other signal needs the group
+ * running to land, so it is continued. */
+void throttle_yield(Task *t, int sig){
+    Task *g = NULL;
+    int i = 0;
+    for (i=0;i<new_task_num-1;i++){
+        g = list[i];
+        if (g == NULL || !g->throttled || g->pgid != t->pgid) continue;
+        throttle_unhold(g);
+        if (sig != SIGTSTP){
+            g->throttle_conts++;
+            continue;
+        }
+        g->status = LOG_STATE_SUSPENDED;
+        publish(g);
+        log_anav_status_change(g->task_num, g->pid, g->type, g->cmd, LOG_SUSPEND);
+    }
+    if (sig != SIGTSTP) send_signal(t->pgid, SIGCONT);
+}
+
+/* Moves throttling on to the next part of its period once the current one
+ * is over, and returns when that one ends. With a duty cycle background
+ * tasks run for throttle percent of each period and are stopped for the
+ * rest; with -t idle each period only picks up tasks started since. */
+long long throttle_tick(){
+    long long now = now_ns();
+    if (now < throttle_next) return throttle_next;
+    if (throttle == THROTTLE_IDLE){
+        throttle_held = 1;
+        throttle_next = now + THROTTLE_PERIOD_NS;
+    }
+    else{
+        throttle_held = !throttle_held;
+        throttle_next = now + THROTTLE_PERIOD_NS * (throttle_held ? 100 - throttle : throttle) / 100;
+    }
+    throttle_apply(throttle_held);
+    return throttle_next;
+}
+
+void shard_exited(const ShardEvent *e);
+void uring_changed(int pid, long long ns);
+
+/* Sleeps until stdin has input (when want_stdin is set), a signal has been
+ * handled or control socket clients have been served. Handled signals are
+ * only taken in here, so the rest of the shell never races the handler.
+ * Returns 1 if stdin is readable. */
+int event_wait(int want_stdin){
+    static struct pollfd *fds = NULL;
+    static Task **polled = NULL;
+    static int fds_size = 0;
+    int old_size = 0;
+    sigset_t none;
+    int n = 0;
+    int i = 0;
+    int first_exec = 0;
+    int first_capture = 0;
+    int first_adopted = 0;
+    int first_ctl = 0;
+    int first_metrics = 0;
+    int shard_at = -1;
+    int uring_at = -1;
+    struct timespec timeout;
+    struct timespec *wait = NULL;
+    long long due = 0;
+    long long next = 0;
+    if (journal_on && journal_should_compact()) compact();
+    /* Overdue duplicates start first, and the wait lasts no longer than
+     * until the next hedged task falls due, throttling's period turns, top
+     * redraws, the next replayed command runs or a wait times out */
+    if (hedgeable.count > 0) due = hedge_check();
+    if (throttling && (next = throttle_tick()) > 0 && (due == 0 || next < due)) due = next;
+    if (top.on && (due == 0 || top.next < due)) due = top.next;
+    if (replay_due > 0 && (due == 0 || replay_due < due)) due = replay_due;
+    if (waitset.on && waitset.due > 0 && (due == 0 || waitset.due < due)) due = waitset.due;
+    if (due > 0){
+        due -= now_ns();
+        if (due < 0) due = 0;
+        timeout.tv_sec = due / 1000000000LL;
+        timeout.tv_nsec = due % 1000000000LL;
+        wait = &timeout;
+    }
+    if (fds_size < 2 + num_execs + captures.count + adopted.count + CTL_MAX_FDS + METRICS_MAX_FDS){
+        old_size = fds_size;
+        fds_size = 2 + (num_execs + captures.count + adopted.count)*2 + CTL_MAX_FDS + METRICS_MAX_FDS;
+        fds = realloc(fds, fds_size*sizeof(struct pollfd));
+        polled = realloc(polled, fds_size*sizeof(Task*));
+        if (fds == NULL || polled == NULL) exit(1);
+        mem_resize(MEM_INDEX, old_size*(sizeof(struct pollfd) + sizeof(Task*)), fds_size*(sizeof(struct pollfd) + sizeof(Task*)));
+    }
+    sigemptyset(&none);
+    if (want_stdin) fds[n++] = (struct pollfd){STDIN_FILENO, POLLIN, 0};
+    if (shards_on){
+        shard_at = n;
+        fds[n++] = (struct pollfd){shard_fd(), POLLIN, 0};
+    }
+    /* Everything watched since the last pass goes to the ring in one call */
+    if (uring_on){
+        uring_submit();
+        uring_at = n;
+        fds[n++] = (struct pollfd){uring_fd(), POLLIN, 0};
+    }
+    first_exec = n;
+    for (i=0;i<num_execs;i++) fds[n++] = (struct pollfd){execs[i].fd, POLLIN, 0};
+    first_capture = n;
+    for (i=0;i<captures.count;i++){
+        polled[n] = captures.tasks[i];
+        fds[n++] = (struct pollfd){captures.tasks[i]->cap_fd, POLLIN, 0};
+    }
+    first_adopted = n;
+    for (i=0;i<adopted.count;i++){
+        polled[n] = adopted.tasks[i];
+        fds[n++] = (struct pollfd){adopted.tasks[i]->pidfd, POLLIN, 0};
+    }
+    first_ctl = n;
+    n += ctl_fds(fds+n, CTL_MAX_FDS);
+    first_metrics = n;
+    n += metrics_fds(fds+n, METRICS_MAX_FDS);
+    if (ppoll(fds, n, wait, &none) <= 0) return 0;
+    /* Apply the exits the shard threads reaped, a batch at a time */
+    if (shard_at != -1 && fds[shard_at].revents != 0 && shards_drain(shard_exited) > 0){
+        start_dependents();
+    }
+    if (uring_at != -1 && fds[uring_at].revents != 0 && uring_drain(uring_changed) > 0){
+        start_dependents();
+    }
+    /* Backwards, as a seen exec is replaced by the last one, which is
+     * either done with or was spawned after the poll */
+    for (i=first_capture-1;i>=first_exec;i--){
+        if (fds[i].revents != 0) exec_seen(i - first_exec);
+    }
+    /* Drain output before running socket commands, which may purge tasks */
+    for (i=first_capture;i<first_adopted;i++){
+        if (fds[i].revents != 0) drain_capture(polled[i]);
+    }
+    for (i=first_adopted;i<first_ctl;i++){
+        if (fds[i].revents != 0) adopted_exited(polled[i]);
+    }
+    ctl_service(fds+first_ctl, first_metrics-first_ctl, socket_command);
+    metrics_service(fds+first_metrics, n-first_metrics, render_metrics);
+    return want_stdin && fds[0].revents != 0;
+}
+
+/* Stalls the shell until the foreground task changes status. Signals are
+ * blocked since the task was started, so no change can have been missed.
+ * With throttle on, background tasks are held back until then. */
+void foreground(Task *t){
+    fg_task = t;
+    if (throttle){
+        throttling = 1;
+        throttle_held = 0;
+        throttle_next = 0;
+    }
+    while (fg_task == t) event_wait(0);
+    if (throttle){
+        throttling = 0;
+        throttle_apply(0);
+    }
+}
+
+/* Records a bench run that finished. Returns 1 if pid is a bench run, which
+ * is no task's process. (Signal Handler Safe) */
+int bench_reaped(int pid, int wstatus, const struct rusage *usage, long long recv_ns){
+    int k = 0;
+    int n = 0;
+    Task *run = NULL;
+    for (k=0;k<bench.par;k++){
+        if (bench.runs[k].pid == pid){
+            run = &bench.runs[k];
+            break;
+        }
+    }
+    if (run == NULL) return 0;
+    if (!WIFEXITED(wstatus) && !WIFSIGNALED(wstatus)) return 1;
+    if (bench.seq[k] >= bench.warmup){
+        n = bench.count++;
+        bench.wall[n] = (recv_ns - run->start_ns) / 1e6;
+        bench.user[n] = usage->ru_utime.tv_sec*1e3 + usage->ru_utime.tv_usec/1e3;
+        bench.sys[n] = usage->ru_stime.tv_sec*1e3 + usage->ru_stime.tv_usec/1e3;
+        bench.rss[n] = usage->ru_maxrss;
+        if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) bench.failed++;
+    }
+    run->pid = 0;
+    bench.active--;
+    return 1;
+}
+
+/* Applies one status change of a child to its task, found through the pid
+ * index, or to a bench run. recv_ns is when the shell learned of it.
+ * (Signal Handler Safe) */
+void child_changed(int pid, int wstatus, const struct rusage *usage, long long recv_ns){
+    int status = 0;
+    int transition = 0;
+    Task *t = NULL;
+    if (bench_reaped(pid, wstatus, usage, recv_ns)) return;
+    t = pidmap_get(pid);
+    /* An orphan reaped before it could be adopted came from a tree that
+     * lost a process in this pass; with its tag gone with it, its resources
+     * go to the last of those, a guess when there are several */
+    if (t == NULL && (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) && pid != zygote_pid && reparented.count > 0){
+        orphan_reaped(reparented.tasks[reparented.count-1], usage);
+    }
+    if (t == NULL) return;
+    if (pid != t->pid){
+        orphan_changed(t, pid, wstatus, usage);
+        return;
+    }
+    /* Its children are re-parented to the shell and adopted after the pass */
+    if ((WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) && (!t->attempt || t->primary != NULL)){
+        watch_add(&reparented, t->attempt ? t->primary : t);
+    }
+    if (t->attempt || t->hedge != NULL) t = hedge_changed(t, pid, wstatus, recv_ns);
+    if (t == NULL) return;
+    /* Handle the signal and update the process' status */
+    extract(wstatus, &status, &transition); 
+    /* Throttling's own stops and continues change nothing for the task. A
+     * stop followed by a continue before the reap is reported as the
+     * continue alone, so that drops any stop still expected. */
+    if (transition == LOG_SUSPEND && t->throttle_stops > 0 && WSTOPSIG(wstatus) == SIGSTOP){
+        t->throttle_stops--;
+        return;
+    }
+    if (transition == LOG_RESUME && t->throttle_conts > 0){
+        t->throttle_conts--;
+        t->throttle_stops = 0;
+        return;
+    }
+    if (t == fg_task) fg_task = NULL;
+    /* Another change in the same wake-up means it no longer runs in the foreground */
+    if (t == fg_resumed) fg_resumed = NULL;
+    t->status = status;
+    t->exit_code = WEXITSTATUS(wstatus);
+    if (status == LOG_STATE_FINISHED || status == LOG_STATE_KILLED){
+        t->end_ns = recv_ns;
+        t->usage = *usage;
+        trace_task(t);
+        pidmap_del(pid);
+        /* Only a run that exited on its own has a result worth keeping */
+        if (t->cache_key[0] != '\0' && status == LOG_STATE_FINISHED) cache_store(t->cache_key, t->run_out, t->exit_code);
+        t->cache_key[0] = '\0';
+        if (t->slot) group_release(t, recv_ns, usage);
+        if (t->throttled) throttle_unhold(t);
+        t->throttle_stops = t->throttle_conts = 0;
+        wait_resolved(t);
+        drop_redirects(t);
+        if (t->hedged) watch_remove(&hedgeable, t);
+        if (hedge_on && status == LOG_STATE_FINISHED) hist_record(runtimes_of(t->argv[0]), run_ns(t, recv_ns));
+        if (predict_on && status == LOG_STATE_FINISHED) predict_record(t->argv, recv_ns - t->start_ns);
+    }
+    /* A typed resume hands the terminal to the task once it runs again */
+    if (transition == LOG_RESUME && t->resume_fg){
+        t->type = 0;
+        t->resume_fg = 0;
+        fg_resumed = t;
+    }
+    publish(t);
+    log_anav_status_change(t->task_num, pid, t->type, t->cmd, transition);
+    if (lat_on){
+        if (t->signal_ns != 0){
+            hist_record(&latency[LAT_SIG_CHLD], recv_ns - t->signal_ns);
+            t->signal_ns = 0;
+        }
+        hist_record(&latency[LAT_CHLD_LOG], now_ns() - recv_ns);
+    }
+    if (metrics_on) hist_record(&reap_latency, now_ns() - recv_ns);
+    if (session_on && (status == LOG_STATE_FINISHED || status == LOG_STATE_KILLED)){
+        session_exited(t->task_num, recv_ns - t->start_ns, WIFSIGNALED(wstatus) ? 128 + WTERMSIG(wstatus) : t->exit_code, now_ns() - recv_ns);
+    }
+    /* A pipeline stage stopped or continued on its own drags the rest of its gang along */
+    if (t->gang != 0 && transition == LOG_SUSPEND){
+        send_signal(t->pgid, SIGSTOP);
+    }
+    else if (t->gang != 0 && transition == LOG_RESUME){
+        send_signal(t->pgid, SIGCONT);
+    }
+}
+
+/* Applies an exit a shard thread reaped */
+void shard_exited(const ShardEvent *e){
+    child_changed(e->pid, e->wstatus, &e->usage, e->ns);
+}
+
+/* Collects the change the ring reported for pid, with its rusage, and
+ * watches the child again unless it is gone */
+void uring_changed(int pid, long long ns){
+    struct rusage usage;
+    int wstatus = 0;
+    int n = wait4(pid, &wstatus, WNOHANG | WUNTRACED | WCONTINUED, &usage);
+    if (n == 0) uring_watch(pid);
+    if (n <= 0) return;
+    child_changed(pid, wstatus, &usage, ns);
+    if (!WIFEXITED(wstatus) && !WIFSIGNALED(wstatus)) uring_watch(pid);
+}
+
+void handler(int sig){
+    int wstatus = 0;
+    int pid = -1;
+    int i = 0;
+    struct rusage usage;
+    siginfo_t info;
+    long long recv_ns = now_ns();
+    block();
+    /* Handles any status change from children */
+    if (sig == SIGCHLD && shards_on){
+        /* Exits belong to the shard threads; only stops and continues are
+         * collected here */
+        memset(&usage, 0, sizeof(usage));
+        while (1){
+            info.si_pid = 0;
+            if (waitid(P_ALL, 0, &info, WSTOPPED | WCONTINUED | WNOHANG) == -1 || info.si_pid == 0) break;
+            child_changed(info.si_pid, wstatus_of(&info), &usage, recv_ns);
+        }
+        start_dependents();
+    }
+    else if (sig == SIGCHLD){
+        /* Reap in a loop until there are no more signals to handle */
+        while (1){
+            pid = wait4(-1, &wstatus, WNOHANG | WUNTRACED | WCONTINUED, &usage);
+            /* Stop once no child has anything left to report; running tasks
+             * re-adopted from the journal are not children and never do */
+            if (pid <= 0) break;
+            child_changed(pid, wstatus, &usage, recv_ns);
+        }
+        /* Finished tasks may release tasks waiting on them */
+        start_dependents();
+    }
+    /* A keyboard signal during bench interrupts its runs and ends it */
+    else if (bench.runs != NULL){
+        bench.stop = 1;
+        for (i=0;i<bench.par;i++){
+            if (bench.runs[i].pid != 0) send_signal(bench.runs[i].pgid, SIGINT);
+        }
+        if (sig == SIGINT) log_anav_ctrl_c();
+        else if (sig == SIGTSTP) log_anav_ctrl_z();
+    }
+    /* A keyboard signal during top ends it */
+    else if (top.on){
+        top.stop = 1;
+        if (sig == SIGINT) log_anav_ctrl_c();
+        else if (sig == SIGTSTP) log_anav_ctrl_z();
+    }
+    /* and one during wait ends the wait, leaving its tasks alone */
+    else if (waitset.on){
+        waitset.stop = 1;
+        if (sig == SIGINT) log_anav_ctrl_c();
+        else if (sig == SIGTSTP) log_anav_ctrl_z();
+    }
+    /* Handle any keyboard signals */
+    else{
+        for (i=0;i<new_task_num-1;i++){
+            if (list[i] != NULL){
+                if (list[i]->type == 0 && list[i]->status == LOG_STATE_RUNNING){
+                    if (lat_on) list[i]->signal_ns = recv_ns;
+                    send_signal(list[i]->pgid, sig);
+                    if (sig == SIGINT) log_anav_ctrl_c();
+                    else if (sig == SIGTSTP) log_anav_ctrl_z();
+                    break;
+                }
+            }
+        }
+    }
+    unblock();
+}
+
+/* Logs and replies that a task number does not exist */
+void no_task(int task_num, Reply *r){
+    log_anav_task_num_error(task_num);
+    reply_add(r, "err no_task task=%d", task_num);
+}
+
+/* Logs and replies that a task is in the wrong state for a command */
+void bad_state(Task *t, Reply *r){
+    log_anav_status_error(t->task_num, t->status);
+    reply_add(r, "err bad_state task=%d state=%s", t->task_num, state_names[t->status]);
+}
+
+/* Prints each group's slots, queue and usage, and its share of the slot
+ * time its parent's runs held */
+void print_groups(Reply *r){
+    double share = 0;
+    Group *g = NULL;
+    int i = 0;
+    for (i=0;i<num_groups;i++){
+        g = groups[i];
+        share = g->parent->slot_secs > 0 ? 100 * g->slot_secs / g->parent->slot_secs : 0;
+        log_anav_group_info(g->name, g->weight, g->running, g->queued, g->cpu, g->slot_secs, share);
+        reply_add(r, "group name=%s weight=%d running=%d queued=%d cpu=%.3f slot_secs=%.3f share=%.1f", g->name,
+                  g->weight, g->running, g->queued, g->cpu, g->slot_secs, share);
+    }
+}
+
+void cmd_list(const char *cmd, Reply *r){
+    long long runtime = 0;
+    int i = 0;
+    Task *t = NULL;
+    char deps_str[MAXLINE] = "";
+    log_anav_num_tasks(num_tasks);
+    for (i=0;i<new_task_num-1;i++){
+        if (list[i] != NULL){
+            t = list[i];
+            log_anav_task_info(t->task_num, t->status, t->exit_code, t->pid, t->cmd);
+            runtime = t->status == LOG_STATE_FINISHED || t->status == LOG_STATE_KILLED ? t->end_ns - t->start_ns
+                    : t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED ? now_ns() - t->start_ns : 0;
+            reply_add(r, "task num=%d state=%s pid=%d exit=%d orphans=%d predicted_ms=%.1f runtime_ms=%.1f cmd=%s", t->task_num,
+                      state_names[t->status], t->pid, t->exit_code, t->orphans, t->predicted_ns / 1e6, runtime / 1e6, t->cmd);
+            /* Show the dependency edges under each task */
+            if (strstr(cmd, "--graph") != NULL && t->num_deps > 0){
+                format_deps(deps_str, MAXLINE, t->deps, t->num_deps);
+                log_anav_task_deps(t->task_num, deps_str, t->after_ok, t->waiting);
+            }
+            if (t->queued) log_anav_task_queued(t->task_num, t->group->name);
+            if (t->orphans > 0) log_anav_task_orphans(t->task_num, t->orphans);
+            if (predict_on && t->predicted_ns > 0){
+                log_anav_task_runtime(t->task_num, t->predicted_ns / 1e9, t->predicted_sd / 1e9, runtime / 1e9, t->status);
+            }
+        }
+    }
+    print_groups(r);
+    reply_add(r, "ok tasks=%d", num_tasks);
+}
+
+/* Reports a string copy to cat as allocated, or as freed when freed is set */
+void account_string(int cat, const char *s, int freed){
+    if (s == NULL) return;
+    if (freed) mem_sub(cat, strlen(s) + 1);
+    else mem_add(cat, strlen(s) + 1);
+}
+
+/* Reports an argv copy and its strings, as clone_argv() allocates them */
+void account_argv(char **argv, int freed){
+    int n = 0;
+    if (argv == NULL) return;
+    for (n=0;argv[n] != NULL;n++) account_string(MEM_ARGV, argv[n], freed);
+    if (freed) mem_sub(MEM_ARGV, (n+1)*sizeof(char*));
+    else mem_add(MEM_ARGV, (n+1)*sizeof(char*));
+}
+
+/* Puts a new task with the given number in the list, doubling the list until
+ * the number fits. Slots stay NULL until a task is put in them. */
+Task* new_task(int task_num, const char *cmd, char **argv){
+    int i = 0;
+    Task task = {task_num, 0, string_copy(cmd), clone_argv(argv), LOG_STATE_READY, 0, 0, 0, 0};
+    task.cap_fd = -1;
+    task.pidfd = -1;
+    ring_init(&task.out, capture_bytes);
+    account_string(MEM_COMMANDS, task.cmd, 0);
+    account_argv(task.argv, 0);
+    while (task_num > list_size){
+        mem_resize(MEM_TABLE, list_size*sizeof(Task*), list_size*2*sizeof(Task*));
+        list_size *= 2;
+        list = realloc(list, (list_size)*(sizeof(Task*)));
+        if (list == NULL) exit(1);
+        for (i=list_size/2;i<list_size;i++) list[i] = NULL;
+    }
+    list[task_num-1] = malloc(sizeof(Task));
+    if (list[task_num-1] == NULL) exit(1);
+    mem_add(MEM_TASKS, sizeof(Task));
+    *list[task_num-1] = task;
+    if (task_num >= new_task_num) new_task_num = task_num + 1;
+    num_tasks++;
+    return list[task_num-1];
+}
+
+/* Removes a task from the list and frees it */
+void free_task(Task *t){
+    int task_num = t->task_num;
+    JRecord r;
+    if (journal_on){
+        task_record(t, &r, JOURNAL_PURGE);
+        journal_append(&r, NULL, 0);
+    }
+    if (t->waiting) num_waiting--;
+    if (t->queued) group_dequeue(t);
+    if (waitset.on) wait_forget(t);
+    if (t->group != NULL) t->group->members--;
+    if (t->pid != 0 && pidmap_get(t->pid) == t) pidmap_del(t->pid);
+    if (t->pidfd != -1){
+        watch_remove(&adopted, t);
+        close(t->pidfd);
+    }
+    drop_capture(t);
+    ring_free(&t->out);
+    account_string(MEM_COMMANDS, t->cmd, 1);
+    account_string(MEM_COMMANDS, t->infile, 1);
+    account_string(MEM_COMMANDS, t->outfile, 1);
+    account_argv(t->argv, 1);
+    if (t->deps != NULL) mem_sub(MEM_DEPS, (t->num_deps+1)*sizeof(int));
+    mem_sub(MEM_TASKS, sizeof(Task));
+    free(t->cmd);
+    free_argv(t->argv); 
+    free(t->deps);
+    free(t->infile);
+    free(t->outfile);
+    drop_redirects(t);
+    free(t);
+    list[task_num-1] = NULL; 
+    if (shm_on) shm_table_clear(task_num);
+    num_tasks--;
+}
+
+void cmd_purge(Instruction *inst, Reply *r){
+    Task *t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    /* Orphans still running are accounted to it until they exit */
+    if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED || t->orphans > 0){
+        bad_state(t, r);
+        return;
+    }
+    free_task(t);
+    log_anav_purge(inst->id1);
+    reply_add(r, "ok task=%d", inst->id1);
+    /* Tasks waiting on the purged one can no longer start */
+    start_dependents();
+}
+
+void cmd_latency(char *argv[], Reply *r){
+    int i = 0;
+    if (argv[1] != NULL && strcmp(argv[1], "on") == 0){
+        lat_on = 1;
+        log_anav_latency_state(lat_on);
+    }
+    else if (argv[1] != NULL && strcmp(argv[1], "off") == 0){
+        lat_on = 0;
+        log_anav_latency_state(lat_on);
+    }
+    else if (argv[1] != NULL && strcmp(argv[1], "reset") == 0){
+        for (i=0;i<LAT_PHASES;i++) hist_reset(&latency[i]);
+        log_anav_latency_state(lat_on);
+    }
+    else{
+        print_latency();
+    }
+    reply_add(r, "ok latency=%s", lat_on ? "on" : "off");
+}
+
+void cmd_after(Instruction *inst, char *argv[], Reply *r){
+    int deps[MAXARGS] = {0};
+    int num_deps = 0;
+    int after_ok = 0;
+    char deps_str[MAXLINE] = "";
+    int i = 0;
+    Task *t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
+        bad_state(t, r);
+        return;
+    }
+    /* Collect the dependencies, skipping the redirects already parsed */
+    for (i=2;argv[i] != NULL;i++){
+        if (argv[i][0] == '<' || argv[i][0] == '>'){
+            if (argv[i][1] == '\0') i++;
+            if (argv[i] == NULL) break;
+            continue;
+        }
+        if (strncmp(argv[i], "ok", 3) == 0){
+            after_ok = 1;
+            continue;
+        }
+        deps[num_deps] = atoi(argv[i]);
+        if (get_task(deps[num_deps]) == NULL){
+            no_task(deps[num_deps], r);
+            return;
+        }
+        if (reaches(deps[num_deps], t->task_num)){
+            log_anav_after_cycle(t->task_num, deps[num_deps]);
+            reply_add(r, "err cycle task=%d dep=%d", t->task_num, deps[num_deps]);
+            return;
+        }
+        num_deps++;
+    }
+    if (t->waiting) num_waiting--;
+    if (t->deps != NULL) mem_sub(MEM_DEPS, (t->num_deps+1)*sizeof(int));
+    account_string(MEM_COMMANDS, t->infile, 1);
+    account_string(MEM_COMMANDS, t->outfile, 1);
+    free(t->deps);
+    free(t->infile);
+    free(t->outfile);
+    t->deps = malloc((num_deps+1)*sizeof(int));
+    if (t->deps == NULL) exit(1);
+    mem_add(MEM_DEPS, (num_deps+1)*sizeof(int));
+    memcpy(t->deps, deps, num_deps*sizeof(int));
+    t->num_deps = num_deps;
+    t->after_ok = after_ok;
+    t->infile = string_copy(inst->infile);
+    t->outfile = string_copy(inst->outfile);
+    account_string(MEM_COMMANDS, t->infile, 0);
+    account_string(MEM_COMMANDS, t->outfile, 0);
+    t->waiting = (num_deps > 0);
+    if (t->waiting) num_waiting++;
+    format_deps(deps_str, MAXLINE, deps, num_deps);
+    log_anav_after(t->task_num, deps_str, after_ok);
+    reply_add(r, "ok task=%d deps=%d", t->task_num, num_deps);
+    /* Dependencies that already finished release the task right away */
+    start_dependents();
+}
+
+/* Runs exec, bg and pipe. A task started from the control socket never takes
+ * the terminal, so there exec behaves like bg. */
+void cmd_start(Instruction *inst, Reply *r, long long read_ns, long long parse_ns){
+    int pipefd[2] = {0};
+    int fg = (r == NULL && strcmp(inst->instruct, "bg") != 0);
+    Task *t2 = NULL;
+    Task *t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
+        bad_state(t, r);
+        return;
+    }
+    if (strcmp(inst->instruct, "pipe") == 0){
+        if (inst->id1 == inst->id2){
+            log_anav_pipe_error(inst->id1);
+            reply_add(r, "err pipe_self task=%d", inst->id1);
+            return;
+        }
+        /* Check the second stage before anything is started */
+        t2 = get_task(inst->id2);
+        if (t2 == NULL){
+            no_task(inst->id2, r);
+            return;
+        }
+        if (t2->status == LOG_STATE_RUNNING || t2->status == LOG_STATE_SUSPENDED){
+            bad_state(t2, r);
+            return;
+        }
+        /* A gang runs two tasks on what would be one group slot, so it
+         * stays out of the groups altogether */
+        if (t->group != NULL || t2->group != NULL){
+            if (t->group == NULL) t = t2;
+            log_anav_pipe_grouped(t->task_num, t->group->name);
+            reply_add(r, "err pipe_grouped task=%d group=%s", t->task_num, t->group->name);
+            return;
+        }
+        if (pipe(pipefd) == -1){
+            log_anav_file_error(inst->id1, LOG_FILE_PIPE);
+            reply_add(r, "err pipe_failed task=%d", inst->id1);
+            return;
+        }
+    }
+    /* Starting a waiting task by hand replaces the wait, and a queued one
+     * leaves its queue */
+    if (t->waiting){
+        t->waiting = 0;
+        num_waiting--;
+    }
+    if (t->queued) group_dequeue(t);
+    if (t2 != NULL){
+        log_anav_pipe(inst->id1, inst->id2);
+        if (t2->waiting){
+            t2->waiting = 0;
+            num_waiting--;
+        }
+        if (t2->queued) group_dequeue(t2);
+        /* First stage leads a new process group, the second stage joins it */
+        t->type = 1;
+        t->gang = t2->task_num;
+        t->status = LOG_STATE_RUNNING;
+        if (spawn(t, 0, -1, pipefd[WRITE_END], pipefd[READ_END], NULL, NULL) == -1){
+            close(pipefd[READ_END]);
+            close(pipefd[WRITE_END]);
+            t->gang = 0;
+            start_failed(t);
+            wait_resolved(t2);
+            reply_add(r, "err spawn_failed task=%d", t->task_num);
+            return;
+        }
+        lat_spawned(t, read_ns, parse_ns);
+        log_anav_status_change(t->task_num, t->pid, LOG_BG, t->cmd, LOG_START);
+
+        t2->type = fg ? 0 : 1;
+        t2->gang = t->task_num;
+        t2->status = LOG_STATE_RUNNING;
+        if (spawn(t2, t->pgid, pipefd[READ_END], -1, pipefd[WRITE_END], NULL, NULL) == -1){
+            close(pipefd[READ_END]);
+            close(pipefd[WRITE_END]);
+            /* The first stage would write into a pipe nobody reads, it goes
+             * and is reaped as killed */
+            t->gang = t2->gang = 0;
+            send_signal(t->pgid, SIGKILL);
+            start_failed(t2);
+            reply_add(r, "err spawn_failed task=%d", t2->task_num);
+            return;
+        }
+        lat_spawned(t2, read_ns, parse_ns);
+        close(pipefd[READ_END]);
+        close(pipefd[WRITE_END]);
+        log_anav_status_change(t2->task_num, t2->pid, t2->type, t2->cmd, LOG_START);
+        reply_add(r, "ok task=%d pid=%d task2=%d pid2=%d", t->task_num, t->pid, t2->task_num, t2->pid);
+        /* Stall until foreground process is updated */
+        if (fg) foreground(t2);
+        return;
+    }
+    /* Set the type to background */
+    t->type = fg ? 0 : 1;
+    t->gang = 0;
+    if (prepare_run(t, inst->infile, inst->outfile)){
+        reply_add(r, "ok task=%d cached exit=%d", t->task_num, t->exit_code);
+        start_dependents();
+        return;
+    }
+    /* A grouped task waits for a slot in the background; in the foreground
+     * it runs at once, holding one */
+    if (t->group != NULL && !fg){
+        group_enqueue(t);
+        group_dispatch();
+        if (t->queued) reply_add(r, "ok task=%d queued group=%s", t->task_num, t->group->name);
+        else if (t->status != LOG_STATE_RUNNING) reply_add(r, "err spawn_failed task=%d", t->task_num);
+        else reply_add(r, "ok task=%d pid=%d", t->task_num, t->pid);
+        return;
+    }
+    if (t->group != NULL) group_hold(t);
+    t->status = LOG_STATE_RUNNING;
+    if (spawn(t, 0, -1, -1, -1, inst->infile, inst->outfile) == -1){
+        start_failed(t);
+        reply_add(r, "err spawn_failed task=%d", t->task_num);
+        return;
+    }
+    lat_spawned(t, read_ns, parse_ns);
+    hedge_arm(t);
+    log_anav_status_change(t->task_num, t->pid, t->type, t->cmd, LOG_START);
+    reply_add(r, "ok task=%d pid=%d", t->task_num, t->pid);
+    /* Stall until foreground process is updated */
+    if (fg) foreground(t);
+}
+
+void cmd_signal(Instruction *inst, Reply *r){
+    int sig = 0;
+    Task *t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    /* A finished task is signalled while orphans of its tree still run */
+    if ((t->status == LOG_STATE_READY || t->status == LOG_STATE_FINISHED || t->status == LOG_STATE_KILLED) && t->orphans == 0){
+        bad_state(t, r);
+        return;
+    }
+    /* Signal the whole process tree so every stage of a pipeline, and every
+     * process they started, moves together */
+    if (lat_on) t->signal_ns = now_ns();
+    if (t->throttled && throttle != THROTTLE_IDLE) throttle_yield(t, strcmp(inst->instruct, "suspend") == 0 ? SIGTSTP : SIGCONT);
+    if (strcmp(inst->instruct, "kill") == 0){
+        sig = SIGINT;
+        log_anav_sig_sent(LOG_CMD_KILL, t->task_num, t->pid);
+    }
+    else if (strcmp(inst->instruct, "suspend") == 0){
+        sig = SIGTSTP;
+        log_anav_sig_sent(LOG_CMD_SUSPEND, t->task_num, t->pid);
+    }
+    else if (strcmp(inst->instruct, "resume") == 0){
+        t->resume_fg = (r == NULL);
+        sig = SIGCONT;
+        log_anav_sig_sent(LOG_CMD_RESUME, t->task_num, t->pid);
+    }
+    signal_tree(t, sig);
+    /* A duplicate racing the task moves with it */
+    if (t->hedge != NULL) signal_tree(t->hedge, sig);
+    reply_add(r, "ok task=%d pid=%d", t->task_num, t->pid);
+}
+
+int cmp_double(const void *a, const void *b){
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Summarizes n samples, sorting them in place */
+void summarize(double *v, int n, Summary *s){
+    double sum = 0;
+    double sq = 0;
+    double q1 = 0;
+    double q3 = 0;
+    int i = 0;
+    memset(s, 0, sizeof(Summary));
+    if (n == 0) return;
+    qsort(v, n, sizeof(double), cmp_double);
+    for (i=0;i<n;i++) sum += v[i];
+    s->mean = sum / n;
+    for (i=0;i<n;i++) sq += (v[i] - s->mean) * (v[i] - s->mean);
+    s->sd = n > 1 ? sqrt(sq / (n - 1)) : 0;
+    s->min = v[0];
+    s->max = v[n-1];
+    /* Nearest rank percentiles */
+    s->p50 = v[(n+1)/2 - 1];
+    s->p95 = v[(int)ceil(n * 0.95) - 1];
+    s->p99 = v[(int)ceil(n * 0.99) - 1];
+    /* Tukey's fences, once there are enough samples for quartiles */
+    q1 = v[(n-1)/4];
+    q3 = v[3*(n-1)/4];
+    for (i=0;i<n && n >= 4;i++){
+        if (v[i] < q1 - 1.5*(q3 - q1) || v[i] > q3 + 1.5*(q3 - q1)) s->outliers++;
+    }
+}
+
+/* Starts the next bench run of t in a free slot. Signals must be blocked. */
+void bench_start(Task *t, int null_in, int null_out){
+    int k = 0;
+    Task *run = NULL;
+    for (k=0;k<bench.par && bench.runs[k].pid != 0;k++);
+    run = &bench.runs[k];
+    /* A copy of the task that shares its command line and is never listed */
+    *run = *t;
+    run->pid = 0;
+    run->bench_run = 1;
+    run->type = 1;
+    run->gang = 0;
+    run->status = LOG_STATE_RUNNING;
+    run->cap_fd = -1;
+    run->pidfd = -1;
+    run->run_in = run->run_out = NULL;
+    run->hedge = NULL;
+    run->group = NULL;
+    run->slot = 0;
+    run->orphans = 0;
+    ring_init(&run->out, 0);
+    bench.seq[k] = bench.started++;
+    if (spawn(run, 0, null_in, null_out, -1, NULL, NULL) <= 0){
+        run->pid = 0;
+        if (bench.seq[k] >= bench.warmup) bench.failed++;
+        return;
+    }
+    bench.active++;
+}
+
+/* bench TASK RUNS [warmup N] [par N]: runs the task's command RUNS times
+ * after N warmup runs, N at a time, through the normal spawn and reap path.
+ * The runs read from and write to /dev/null and leave the task itself alone.
+ * The shell waits for them, so it is not offered on the control socket. */
+void cmd_bench(Instruction *inst, char *argv[], Reply *r){
+    const char *names[] = {"wall", "user", "sys", "maxrss"};
+    const char *units[] = {"ms", "ms", "ms", "KiB"};
+    double *samples[4];
+    Summary sum;
+    int runs = argv[1] != NULL && argv[2] != NULL ? atoi(argv[2]) : 0;
+    int warmup = 0;
+    int par = 1;
+    int null_in = -1;
+    int null_out = -1;
+    int i = 0;
+    long long start = 0;
+    Task *t = NULL;
+    if (r != NULL){
+        reply_add(r, "err unsupported");
+        return;
+    }
+    for (i=3;argv[i] != NULL && argv[i+1] != NULL;i+=2){
+        if (strcmp(argv[i], "warmup") == 0) warmup = atoi(argv[i+1]);
+        else if (strcmp(argv[i], "par") == 0) par = atoi(argv[i+1]);
+        else break;
+    }
+    if (runs < 1 || warmup < 0 || par < 1 || argv[i] != NULL){
+        log_anav_bench_usage();
+        return;
+    }
+    t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    if (par > runs + warmup) par = runs + warmup;
+    null_in = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    null_out = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    memset(&bench, 0, sizeof(Bench));
+    bench.runs = calloc(par, sizeof(Task));
+    bench.seq = calloc(par, sizeof(int));
+    bench.wall = calloc(runs, sizeof(double));
+    bench.user = calloc(runs, sizeof(double));
+    bench.sys = calloc(runs, sizeof(double));
+    bench.rss = calloc(runs, sizeof(double));
+    if (bench.runs == NULL || bench.seq == NULL || bench.wall == NULL || bench.user == NULL ||
+        bench.sys == NULL || bench.rss == NULL) exit(1);
+    mem_add(MEM_BENCH, par*(sizeof(Task) + sizeof(int)) + 4*runs*sizeof(double));
+    bench.par = par;
+    bench.warmup = warmup;
+    log_anav_bench(t->task_num, t->cmd, runs, warmup, par);
+
+    start = now_ns();
+    while (1){
+        while (!bench.stop && bench.active < par && bench.started < runs + warmup){
+            bench_start(t, null_in, null_out);
+        }
+        if (bench.active == 0 && (bench.stop || bench.started == runs + warmup)) break;
+        event_wait(0);
+    }
+
+    log_anav_bench_done(bench.count, bench.failed, (now_ns() - start) / 1e9);
+    samples[0] = bench.wall;
+    samples[1] = bench.user;
+    samples[2] = bench.sys;
+    samples[3] = bench.rss;
+    for (i=0;i<4 && bench.count > 0;i++){
+        summarize(samples[i], bench.count, &sum);
+        log_anav_bench_stat(names[i], units[i], sum.mean, sum.sd, sum.min, sum.p50, sum.p95, sum.p99,
+                            sum.max, sum.outliers);
+    }
+    close(null_in);
+    close(null_out);
+    free(bench.runs);
+    free(bench.seq);
+    free(bench.wall);
+    free(bench.user);
+    free(bench.sys);
+    free(bench.rss);
+    mem_sub(MEM_BENCH, par*(sizeof(Task) + sizeof(int)) + 4*runs*sizeof(double));
+    memset(&bench, 0, sizeof(Bench));
+}
+
+/* Busiest first, then in task order */
+int cmp_top(const void *a, const void *b){
+    const TopRow *x = *(TopRow * const *)a;
+    const TopRow *y = *(TopRow * const *)b;
+    if (x->s.cpu_pct != y->s.cpu_pct) return x->s.cpu_pct < y->s.cpu_pct ? 1 : -1;
+    return x->task_num - y->task_num;
+}
+
+/* Formats an I/O rate in KiB/s, or - where it cannot be read */
+void top_rate(char *buf, size_t size, const TopSample *s, double rate){
+    if (s->io_fd == -1) snprintf(buf, size, "-");
+    else snprintf(buf, size, "%.1f", rate / 1024);
+}
+
+/* Samples every running and stopped task, keeping the samplers of tasks
+ * already sampled last tick, and draws the busiest that fit in rows lines.
+ * What the sampling cost is shown in the header. */
+void top_tick(int rows, double secs){
+    char line[MAXLINE + 128];
+    char in_rate[32];
+    char out_rate[32];
+    struct rusage ru;
+    TopRow *rest = NULL;
+    TopRow *row = NULL;
+    Task *t = NULL;
+    long long start = now_ns();
+    long long sample_ns = 0;
+    double cpu = 0;
+    double shell_pct = 0;
+    int n = 0;
+    int j = 0;
+    int i = 0;
+    if (top.size < new_task_num){
+        mem_resize(MEM_INDEX, top.size*(2*sizeof(TopRow) + sizeof(TopRow*)), new_task_num*(2*sizeof(TopRow) + sizeof(TopRow*)));
+        top.size = new_task_num;
+        top.rows = realloc(top.rows, top.size*sizeof(TopRow));
+        top.spare = realloc(top.spare, top.size*sizeof(TopRow));
+        top.order = realloc(top.order, top.size*sizeof(TopRow*));
+        if (top.rows == NULL || top.spare == NULL || top.order == NULL) exit(1);
+    }
+    for (i=0;i<new_task_num-1;i++){
+        t = list[i];
+        if (t == NULL || t->pid <= 0 || (t->status != LOG_STATE_RUNNING && t->status != LOG_STATE_SUSPENDED)) continue;
+        /* Tasks sampled last tick that have since finished or been purged */
+        while (j < top.count && top.rows[j].task_num < t->task_num) top_close(&top.rows[j++].s);
+        row = &top.spare[n];
+        if (j < top.count && top.rows[j].task_num == t->task_num && top.rows[j].s.pid == t->pid) *row = top.rows[j++];
+        else{
+            /* A task started again since has a new process */
+            if (j < top.count && top.rows[j].task_num == t->task_num) top_close(&top.rows[j++].s);
+            if (top_open(&row->s, t->pid) == -1) continue;
+            row->task_num = t->task_num;
+        }
+        if (top_sample(&row->s, start) == -1){
+            top_close(&row->s);
+            continue;
+        }
+        top.order[n++] = row;
+    }
+    while (j < top.count) top_close(&top.rows[j++].s);
+    rest = top.rows;
+    top.rows = top.spare;
+    top.spare = rest;
+    top.count = n;
+    sample_ns = now_ns() - start;
+
+    getrusage(RUSAGE_SELF, &ru);
+    cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+    if (top.last_ns > 0) shell_pct = 100 * (cpu - top.last_cpu) / ((start - top.last_ns) / 1e9);
+    top.last_ns = start;
+    top.last_cpu = cpu;
+    qsort(top.order, n, sizeof(TopRow*), cmp_top);
+
+    snprintf(line, sizeof(line), "top %d tasks %.1fs | sample %.1f ms %.1f us/task | shell CPU %.1f%% | redrew %d",
+             n, secs, sample_ns / 1e6, n ? sample_ns / 1e3 / n : 0.0, shell_pct, top.redrawn);
+    screen_line(0, line);
+    screen_line(1, "Enter or Ctrl-C returns to the shell");
+    snprintf(line, sizeof(line), "%6s %7s %s %6s %9s %10s %11s  %s", "TASK", "PID", "S", "CPU%", "RSS MiB", "READ KiB/s", "WRITE KiB/s", "COMMAND");
+    screen_line(2, line);
+    for (i=0;i<n && i+3<rows;i++){
+        row = top.order[i];
+        t = get_task(row->task_num);
+        top_rate(in_rate, sizeof(in_rate), &row->s, row->s.read_rate);
+        top_rate(out_rate, sizeof(out_rate), &row->s, row->s.write_rate);
+        snprintf(line, sizeof(line), "%6d %7d %c %6.1f %9.1f %10s %11s  %s", row->task_num, row->s.pid, row->s.state,
+                 row->s.cpu_pct, row->s.rss / 1048576.0, in_rate, out_rate, t->cmd);
+        screen_line(i+3, line);
+    }
+    top.redrawn = screen_flush(i+3);
+}
+
+/* Sends the log to a buffer while top holds the terminal, as lines written
+ * between frames would stay on the screen where the frame diff cannot see
+ * them */
+void hold_log(){
+    log_buffer = memfd_create("anav-log", MFD_CLOEXEC);
+    if (log_buffer == -1) return;
+    fflush(stderr);
+    log_held = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (log_held == -1){
+        close(log_buffer);
+        log_buffer = -1;
+        return;
+    }
+    dup2(log_buffer, STDERR_FILENO);
+}
+
+/* Gives the log its terminal back and writes out what was held */
+void release_log(){
+    char buffer[4096];
+    ssize_t n = 0;
+    if (log_held == -1) return;
+    fflush(stderr);
+    dup2(log_held, STDERR_FILENO);
+    close(log_held);
+    log_held = -1;
+    lseek(log_buffer, 0, SEEK_SET);
+    while ((n = read(log_buffer, buffer, sizeof(buffer))) > 0) write(STDERR_FILENO, buffer, n);
+    close(log_buffer);
+    log_buffer = -1;
+}
+
+/* top [SECS]: shows the CPU, RSS, state and I/O rates of running and
+ * stopped tasks, redrawn every SECS seconds (default 1) until a line is
+ * typed or Ctrl-C. The shell serves its children and sockets meanwhile,
+ * and what it logs is shown once top returns.
+ * Like bench it holds the terminal, so it is not offered on the control
+ * socket. */
+void cmd_top(char *argv[], Reply *r){
+    struct winsize ws;
+    double secs = argv[1] != NULL ? atof(argv[1]) : 1;
+    int rows = 24;
+    int cols = 80;
+    int i = 0;
+    if (r != NULL){
+        reply_add(r, "err unsupported");
+        return;
+    }
+    if (secs <= 0 || (argv[1] != NULL && argv[2] != NULL)){
+        log_anav_top_usage();
+        return;
+    }
+    /* The last line is left for the shell */
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 4 && ws.ws_col > 0){
+        rows = ws.ws_row - 1;
+        cols = ws.ws_col;
+    }
+    memset(&top, 0, sizeof(Top));
+    top.on = 1;
+    hold_log();
+    screen_start(rows, cols);
+    while (!top.stop){
+        top_tick(rows, secs);
+        top.next = now_ns() + (long long)(secs * 1e9);
+        while (!top.stop && now_ns() < top.next){
+            if (event_wait(1)){
+                free(get_input());
+                top.stop = 1;
+            }
+        }
+    }
+    screen_end();
+    release_log();
+    for (i=0;i<top.count;i++) top_close(&top.rows[i].s);
+    mem_sub(MEM_INDEX, top.size*(2*sizeof(TopRow) + sizeof(TopRow*)));
+    free(top.rows);
+    free(top.spare);
+    free(top.order);
+    memset(&top, 0, sizeof(Top));
+}
+
+/* Returns 1 if a task has yet to end: it runs, is stopped, or waits on its
+ * dependencies or its group's queue to start */
+int task_pending(Task *t){
+    return t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED || t->waiting || t->queued;
+}
+
+/* Reads a task number or a FIRST-LAST range of them. Returns 0 or -1. */
+int task_range(const char *arg, int *first, int *last){
+    const char *p = NULL;
+    char *end = NULL;
+    *first = *last = strtol(arg, &end, 10);
+    if (end == arg) return -1;
+    if (*end == '-'){
+        p = end + 1;
+        *last = strtol(p, &end, 10);
+        if (end == p) return -1;
+    }
+    return (*end == '\0' && *first >= 1 && *first <= *last) ? 0 : -1;
+}
+
+/* Blocks until every task listed has ended, or with any the first of them,
+ * or until the timeout or a keyboard signal, and prints the exit codes of
+ * those that ended. Without tasks it covers every task yet to end. Tasks
+ * run on untouched when the wait ends early. */
+void cmd_wait(char *argv[], Reply *r){
+    Task *t = NULL;
+    char *seen = NULL;
+    double timeout = 0;
+    int first = 0;
+    int last = 0;
+    int all = 0;
+    int from = 1;
+    int end = 1;
+    int ended = 0;
+    int why = 0;
+    int i = 0;
+    int k = 0;
+    /* The shell's loop would stall every other client behind it */
+    if (r != NULL){
+        reply_add(r, "err unsupported");
+        return;
+    }
+    memset(&waitset, 0, sizeof(WaitSet));
+    if (argv[1] != NULL && strcmp(argv[1], "any") == 0) waitset.any = 1;
+    else if (argv[1] != NULL && strcmp(argv[1], "all") == 0) all = 1;
+    if (waitset.any || all) from = 2;
+    while (argv[end] != NULL) end++;
+    if (end - from >= 2 && strcmp(argv[end-2], "timeout") == 0){
+        timeout = atof(argv[end-1]);
+        end -= 2;
+        if (timeout <= 0){
+            log_anav_wait_usage();
+            return;
+        }
+    }
+    if (all && end > from){
+        log_anav_wait_usage();
+        return;
+    }
+    /* Checked before anything is marked, so a bad argument leaves no task
+     * waited on. A range skips the numbers of purged tasks. */
+    for (k=from;k<end;k++){
+        if (task_range(argv[k], &first, &last) == -1){
+            log_anav_wait_usage();
+            return;
+        }
+        for (i=first;i<=last && i<new_task_num;i++){
+            t = get_task(i);
+            if (t == NULL && first == last){
+                no_task(i, r);
+                return;
+            }
+            /* Never started, it would never end */
+            if (t != NULL && t->status == LOG_STATE_READY && !task_pending(t)){
+                bad_state(t, r);
+                return;
+            }
+        }
+        if (first == last && first >= new_task_num){
+            no_task(first, r);
+            return;
+        }
+    }
+    waitset.tasks = malloc(new_task_num*sizeof(Task*));
+    seen = calloc(new_task_num, 1);
+    if (waitset.tasks == NULL || seen == NULL) exit(1);
+    for (i=1;i<new_task_num;i++){
+        t = get_task(i);
+        if (t == NULL) continue;
+        if (end == from){
+            if (!task_pending(t)) continue;
+        }
+        else{
+            for (k=from;k<end;k++){
+                task_range(argv[k], &first, &last);
+                if (i >= first && i <= last) break;
+            }
+            if (k == end) continue;
+        }
+        if (seen[i]) continue;
+        seen[i] = 1;
+        waitset.tasks[waitset.count++] = t;
+        if (task_pending(t)){
+            t->waited = 1;
+            waitset.left++;
+        }
+    }
+    free(seen);
+    waitset.due = timeout > 0 ? now_ns() + (long long)(timeout * 1e9) : 0;
+    waitset.on = 1;
+    log_anav_wait(waitset.count, waitset.any, timeout);
+    /* Woken by exits, which count the set down from the reaping path */
+    while (!waitset.stop && waitset.left > 0 && !(waitset.any && waitset.left < waitset.count)){
+        if (waitset.due > 0 && now_ns() >= waitset.due) break;
+        event_wait(0);
+    }
+    if (waitset.stop) why = 2;
+    else if (waitset.left > 0 && !(waitset.any && waitset.left < waitset.count)) why = 1;
+    for (i=0;i<waitset.count;i++){
+        t = waitset.tasks[i];
+        if (t == NULL) continue;
+        t->waited = 0;
+        if (t->status != LOG_STATE_FINISHED && t->status != LOG_STATE_KILLED) continue;
+        log_anav_wait_task(t->task_num, t->status, t->exit_code);
+        ended++;
+    }
+    log_anav_wait_done(ended, waitset.count, why);
+    free(waitset.tasks);
+    memset(&waitset, 0, sizeof(WaitSet));
+}
+
+/* Prints what the shell's heap holds by category, next to the allocator's
+ * and the kernel's totals. The per task figure covers everything a task
+ * owns: its record, strings, argv, dependencies and output. */
+void cmd_meminfo(Reply *r){
+    struct mallinfo2 mi = mallinfo2();
+    const MemStat *s = NULL;
+    long long accounted = 0;
+    long long owned = 0;
+    long long rss = 0;
+    long pages = 0;
+    FILE *f = NULL;
+    int i = 0;
+    for (i=0;i<MEM_CATEGORIES;i++){
+        s = mem_stat(i);
+        accounted += s->bytes;
+        if (i != MEM_TABLE && i != MEM_INDEX && i != MEM_BENCH && i != MEM_HEDGE) owned += s->bytes;
+        log_anav_meminfo(mem_name(i), s->blocks, s->bytes, s->peak);
+        reply_add(r, "mem cat=%s blocks=%lld bytes=%lld peak=%lld", mem_name(i), s->blocks, s->bytes, s->peak);
+    }
+    f = fopen("/proc/self/statm", "r");
+    if (f != NULL && fscanf(f, "%*d %ld", &pages) == 1) rss = pages * sysconf(_SC_PAGESIZE);
+    if (f != NULL) fclose(f);
+    log_anav_meminfo_total(accounted, num_tasks ? owned / num_tasks : 0, mi.uordblks + mi.hblkhd, mi.arena + mi.hblkhd, rss);
+    reply_add(r, "ok accounted=%lld heap_used=%zu heap=%zu rss=%lld", accounted, mi.uordblks + mi.hblkhd,
+              mi.arena + mi.hblkhd, rss);
+}
+
+/* Creates a group, and any above it, sets its weight, and puts tasks that
+ * are not running in it. Without a name prints the groups. */
+void cmd_group(char *argv[], Reply *r){
+    Group *g = NULL;
+    Task *t = NULL;
+    int weight = 0;
+    int i = 2;
+    if (argv[1] == NULL){
+        log_anav_groups(num_groups, group_slots);
+        print_groups(r);
+        reply_add(r, "ok groups=%d slots=%d", num_groups, group_slots);
+        return;
+    }
+    if (argv[2] != NULL && strcmp(argv[2], "weight") == 0){
+        weight = argv[3] != NULL ? atoi(argv[3]) : 0;
+        i = 4;
+    }
+    if (!group_name_ok(argv[1]) || (i == 4 && weight < 1)){
+        log_anav_group_usage();
+        reply_add(r, "err usage");
+        return;
+    }
+    g = group_get(argv[1], 1);
+    if (g == NULL){
+        log_anav_group_error(argv[1], "is inside a group that holds tasks");
+        reply_add(r, "err group_nested group=%s", argv[1]);
+        return;
+    }
+    if (weight > 0) g->weight = weight;
+    for (;argv[i] != NULL;i++){
+        t = get_task(atoi(argv[i]));
+        if (t == NULL){
+            no_task(atoi(argv[i]), r);
+            return;
+        }
+        if (g->subgroups > 0){
+            log_anav_group_error(g->name, "holds subgroups, not tasks");
+            reply_add(r, "err group_has_subgroups group=%s", g->name);
+            return;
+        }
+        if (t->status == LOG_STATE_RUNNING || t->status == LOG_STATE_SUSPENDED){
+            bad_state(t, r);
+            return;
+        }
+        group_join(t, g);
+    }
+    log_anav_group(g->name, g->weight, g->members);
+    reply_add(r, "ok group=%s weight=%d tasks=%d", g->name, g->weight, g->members);
+}
+
+/* Marks a task as idempotent, so that from its next start it may be raced
+ * by a duplicate, or with off unmarks it. Without a task prints how the
+ * hedging policy has fared. */
+void cmd_hedge(Instruction *inst, char *argv[], Reply *r){
+    long long settled = hedge_wins + hedge_losses;
+    Task *t = NULL;
+    if (!hedge_on){
+        log_anav_hedge_off();
+        reply_add(r, "err hedge_off");
+        return;
+    }
+    if (argv[1] == NULL){
+        log_anav_hedge_stats(hedge_pct, hedges_launched, hedge_wins, hedge_losses, hedges_dropped,
+                             settled ? 100.0 * hedge_wins / settled : 0);
+        reply_add(r, "ok launched=%lld won=%lld lost=%lld dropped=%lld win_rate=%.3f", hedges_launched,
+                  hedge_wins, hedge_losses, hedges_dropped, settled ? (double)hedge_wins / settled : 0);
+        return;
+    }
+    t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    t->hedged = (argv[2] == NULL || strcmp(argv[2], "off") != 0);
+    if (!t->hedged) watch_remove(&hedgeable, t);
+    log_anav_hedge(t->task_num, t->hedged);
+    reply_add(r, "ok task=%d hedged=%d", t->task_num, t->hedged);
+}
+
+/* Prints the result cache's counters and size */
+void cmd_cache(Reply *r){
+    const CacheStats *s = cache_stats();
+    if (!cache_on){
+        log_anav_cache_off();
+        reply_add(r, "err cache_off");
+        return;
+    }
+    log_anav_cache_stats(s->hits, s->misses, s->stores, s->evictions, s->entries, s->bytes, s->max_bytes);
+    reply_add(r, "ok hits=%lld misses=%lld stores=%lld evictions=%lld entries=%lld bytes=%lld max=%lld",
+              s->hits, s->misses, s->stores, s->evictions, s->entries, s->bytes, s->max_bytes);
+}
+
+/* Prints the last lines of a task's captured output, 10 unless given */
+void cmd_tail(Instruction *inst, char *argv[], Reply *r){
+    int lines = (argv[2] != NULL && atoi(argv[2]) > 0) ? atoi(argv[2]) : 10;
+    size_t n = 0;
+    char *out = NULL;
+    char *line = NULL;
+    char *next = NULL;
+    int count = 0;
+    Task *t = get_task(inst->id1);
+    if (t == NULL){
+        no_task(inst->id1, r);
+        return;
+    }
+    out = ring_tail(&t->out, lines, &n);
+    log_anav_tail(t->task_num, t->out.total, t->out.total - t->out.len);
+    if (r == NULL){
+        write(STDOUT_FILENO, out, n);
+        if (n > 0 && out[n-1] != '\n') write(STDOUT_FILENO, "\n", 1);
+    }
+    else{
+        /* One reply line per output line */
+        out[n] = '\0';
+        for (line = out; n > 0 && *line != '\0'; line = next){
+            next = strchr(line, '\n');
+            if (next != NULL) *next++ = '\0';
+            else next = line + strlen(line);
+            reply_add(r, "out %s", line);
+            count++;
+        }
+        reply_add(r, "ok task=%d lines=%d total=%lld dropped=%lld", t->task_num, count,
+                  t->out.total, t->out.total - (long long)t->out.len);
+    }
+    free(out);
+}
+
+/* Creates a task and adds it to the list */
+void cmd_add(const char *cmd, char *argv[], Reply *r){
+    Task *t = new_task(new_task_num, cmd, argv);
+    log_anav_task_init(t->task_num, t->cmd);
+    journal_task_add(t);
+    publish(t);
+    reply_add(r, "ok task=%d", t->task_num);
+}
+
+/* Runs one command line, which it frees. r is NULL for a typed command and
+ * collects the structured reply for a control socket client.
+ * Returns STOP_SHELL once the shell should quit. */
+int run_command(char *cmd, Reply *r){
+    char *argv[MAXARGS+1] = {0};  /* Argument list */
+    Instruction inst = {0};       /* Instruction structure: check parse.h */
+    long long read_ns = (lat_on || session_on) ? now_ns() : 0;
+    long long parse_ns = 0;
+
+    /* Parse the Command and Populate the Instruction and Arguments */
+    initialize_command(&inst, argv);    /* initialize arg lists and instruction */
+    parse(cmd, &inst, argv);            /* call provided parse() */
+    builtin_parse(&inst, argv);
+    if (lat_on){
+        parse_ns = now_ns();
+        hist_record(&latency[LAT_READ_PARSE], parse_ns - read_ns);
+    }
+
+    if (DEBUG) {  /* display parse result, redefine DEBUG to turn it off */
+      debug_print_parse(cmd, &inst, argv, "main (after parse)");
+    }
+
+    /* Check to see if this is the quit built-in */
+    if (strcmp(inst.instruct, "quit") == 0){
+        free_command(cmd, &inst, argv);
+        /* Only the terminal may end the shell */
+        if (r != NULL){
+            reply_add(r, "err unsupported");
+            return RUN_SHELL;
+        }
+        log_anav_quit();
+        return STOP_SHELL;
+    }
+
+    /* top only draws and waits on the terminal, a replay could not end it */
+    if (session_on && strcmp(inst.instruct, "top") != 0) session_command(cmd, r != NULL);
+
+    if (strcmp(inst.instruct, "help") == 0){
+        log_anav_help();
+        log_anav_builtins();
+        reply_add(r, "ok");
+    }
+    else if (strcmp(inst.instruct, "list") == 0){
+        cmd_list(cmd, r);
+    }
+    else if (strcmp(inst.instruct, "purge") == 0){
+        cmd_purge(&inst, r);
+    }
+    else if (strcmp(inst.instruct, "latency") == 0){
+        cmd_latency(argv, r);
+    }
+    else if (strcmp(inst.instruct, "after") == 0){
+        cmd_after(&inst, argv, r);
+    }
+    else if (strcmp(inst.instruct, "tail") == 0){
+        cmd_tail(&inst, argv, r);
+    }
+    else if (strcmp(inst.instruct, "bench") == 0){
+        cmd_bench(&inst, argv, r);
+    }
+    else if (strcmp(inst.instruct, "meminfo") == 0){
+        cmd_meminfo(r);
+    }
+    else if (strcmp(inst.instruct, "cache") == 0){
+        cmd_cache(r);
+    }
+    else if (strcmp(inst.instruct, "hedge") == 0){
+        cmd_hedge(&inst, argv, r);
+    }
+    else if (strcmp(inst.instruct, "group") == 0){
+        cmd_group(argv, r);
+    }
+    else if (strcmp(inst.instruct, "top") == 0){
+        cmd_top(argv, r);
+    }
+    else if (strcmp(inst.instruct, "wait") == 0){
+        cmd_wait(argv, r);
+    }
+    else if (strcmp(inst.instruct, "exec") == 0 || strcmp(inst.instruct, "bg") == 0 || strcmp(inst.instruct, "pipe") == 0){
+        cmd_start(&inst, r, read_ns, parse_ns);
+    }
+    else if (strcmp(inst.instruct, "kill") == 0 || strcmp(inst.instruct, "suspend") == 0 || strcmp(inst.instruct, "resume") == 0){
+        cmd_signal(&inst, r);
+    }
+    else{
+        cmd_add(builtin_command(cmd), argv, r);
+    }
+
+    /* free_command frees the cmd, inst and argv data, anything kept was copied into the Task */
+    free_command(cmd, &inst, argv);
+    return RUN_SHELL;
+}
+
+/* Runs one line of a control socket request. "add CMD" adds a task like a
+ * typed command line would; blank lines get no reply. */
+void socket_command(const char *line, Reply *r){
+    while (*line == ' ' || *line == '\t' || *line == '\r') line++;
+    if (*line == '\0') return;
+    if (strncmp(line, "add ", 4) == 0) line += 4;
+    if (strlen(line) >= MAXLINE){
+        reply_add(r, "err too_long");
+        return;
+    }
+    run_command(string_copy(line), r);
+}
+
+/* Returns 1 while a task runs or waits in a group's queue for a slot */
+int tasks_busy(){
+    int i = 0;
+    if (root.queued > 0) return 1;
+    for (i=0;i<new_task_num-1;i++){
+        if (list[i] != NULL && list[i]->status == LOG_STATE_RUNNING) return 1;
+    }
+    return 0;
+}
+
+/* Waits for the next event, following any task a resume brought to the
+ * foreground */
+void replay_wait(){
+    Task *t = NULL;
+    event_wait(0);
+    if (fg_resumed != NULL){
+        t = fg_resumed;
+        fg_resumed = NULL;
+        foreground(t);
+    }
+}
+
+/* Runs the loaded recording's commands, each as long after the first as it
+ * came in the recording divided by speed, or right away with speed 0. Once
+ * the tasks have ended, compares the run with the recording. */
+void replay(double speed){
+    const SessionStats *was = session_recorded();
+    const SessionStats *now = session_replayed();
+    const char *cmd = NULL;
+    Reply scratch = {0};
+    long long start = now_ns();
+    long long first = -1;
+    long long ns = 0;
+    int from_socket = 0;
+    while ((cmd = session_next(&ns, &from_socket)) != NULL){
+        if (first == -1) first = ns;
+        replay_due = speed > 0 ? start + (long long)((ns - first) / speed) : 0;
+        while (replay_due > now_ns()) replay_wait();
+        replay_due = 0;
+        log_anav_prompt();
+        log_anav_replay_command(cmd);
+        /* Socket commands run as they did, their replies dropped */
+        scratch.len = 0;
+        run_command(string_copy(cmd), from_socket ? &scratch : NULL);
+    }
+    free(scratch.data);
+    while (tasks_busy()) replay_wait();
+    log_anav_replay_stat("throughput", "tasks/s",
+                         was->exits > 0 ? was->exits / ((was->last_ns - was->first_ns) / 1e9) : 0,
+                         now->exits > 0 ? now->exits / ((now->last_ns - now->first_ns) / 1e9) : 0);
+    log_anav_replay_stat("spawn mean", "us", hist_mean(&was->spawn) / 1e3, hist_mean(&now->spawn) / 1e3);
+    log_anav_replay_stat("spawn p99", "us", hist_percentile(&was->spawn, 99) / 1e3, hist_percentile(&now->spawn, 99) / 1e3);
+    log_anav_replay_stat("reap mean", "us", hist_mean(&was->reap) / 1e3, hist_mean(&now->reap) / 1e3);
+    log_anav_replay_stat("reap p99", "us", hist_percentile(&was->reap, 99) / 1e3, hist_percentile(&now->reap, 99) / 1e3);
+    log_anav_replay_stat("runtime mean", "ms", hist_mean(&was->run) / 1e6, hist_mean(&now->run) / 1e6);
+    log_anav_replay_done(was->exits, now->exits, now->mismatches);
+}
+
+/* The entry of your text processor program */
+int main(int argc, char *args[]) {
+    char *cmd = NULL;
+    int do_run_shell = RUN_SHELL;
+    Task *t = NULL;
+    struct sigaction sa = {0};
+    int opt = 0;
+    char shm_name[32] = "";
+    char *journal_path = NULL;
+    char *metrics_path = NULL;
+    char *textfile_path = NULL;
+    char *cache_dir = NULL;
+    char *record_path = NULL;
+    char *predict_path = NULL;
+    char *replay_path = NULL;
+    double replay_speed = 1;
+    int replay_count = 0;
+    long long cache_max = 1LL << 30;
+    int interval = 15;
+    int fd = -1;
+
+    shell_start_ns = now_ns();
+    shell_pid = getpid();
+    /* Processes that outlive their parent inside a task's tree come back to
+     * the shell, to be reaped and accounted to the task */
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    while ((opt = getopt(argc, args, "c:C:e:g:H:i:j:K:lm:M:p:q:r:R:s:S:t:w:x:X:z")) != -1){
+        switch (opt){
+            case 'c':
+                capture_bytes = atoi(optarg);
+                if (capture_bytes < 1){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                log_anav_capture(capture_bytes);
+                break;
+            case 'C':
+                cache_dir = optarg;
+                break;
+            case 'e':
+                if (strcmp(optarg, "uring") == 0) uring_on = 1;
+                else if (strcmp(optarg, "signal") == 0) uring_on = 0;
+                else{
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                break;
+            case 'g':
+                group_slots = atoi(optarg);
+                if (group_slots < 1){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                break;
+            case 'H':
+                hedge_pct = atof(optarg);
+                if (hedge_pct <= 0 || hedge_pct > 100){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                hedge_on = 1;
+                log_anav_hedging(hedge_pct);
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                if (interval < 1){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                break;
+            case 'j':
+                journal_path = optarg;
+                break;
+            case 'K':
+                cache_max = atoll(optarg);
+                if (cache_max < 1){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                break;
+            case 'l':
+                lat_on = 1;
+                break;
+            case 'm':
+                snprintf(shm_name, sizeof(shm_name), "/anav.%d", getpid());
+                if (atoi(optarg) < 1 || shm_table_open(shm_name, atoi(optarg)) == -1){
+                    log_anav_open_error(shm_name);
+                    exit(1);
+                }
+                shm_on = 1;
+                atexit(shm_table_close);
+                log_anav_shm(shm_name, atoi(optarg));
+                break;
+            case 'M':
+                metrics_path = optarg;
+                break;
+            case 'p':
+                predict_path = optarg;
+                predict_on = 1;
+                break;
+            case 'q':
+                if (strcmp(optarg, "fifo") == 0) queue_order = ORDER_FIFO;
+                else if (strcmp(optarg, "sjf") == 0) queue_order = ORDER_SJF;
+                else if (strcmp(optarg, "finish") == 0) queue_order = ORDER_FINISH;
+                else{
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                predict_on = 1;
+                break;
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'R':
+                replay_path = optarg;
+                break;
+            case 'w':
+                textfile_path = optarg;
+                break;
+            case 'S':
+                shards_on = atoi(optarg);
+                if (shards_on < 1 || shards_on > SHARD_MAX){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                break;
+            case 's':
+                if (ctl_open(optarg) == -1){
+                    log_anav_open_error(optarg);
+                    exit(1);
+                }
+                atexit(ctl_close);
+                log_anav_ctl(optarg);
+                break;
+            case 't':
+                throttle = strcmp(optarg, "idle") == 0 ? THROTTLE_IDLE : atoi(optarg);
+                if (throttle < 1 || throttle > THROTTLE_IDLE){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                log_anav_throttle(throttle == THROTTLE_IDLE ? 0 : throttle);
+                break;
+            case 'x':
+                trace_fd = open(optarg, O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+                if (trace_fd == -1){
+                    log_anav_open_error(optarg);
+                    exit(1);
+                }
+                write(trace_fd, "# id arrival_ms cpu_ms io_ms priority\n", 38);
+                break;
+            case 'X':
+                replay_speed = atof(optarg);
+                if (replay_speed < 0){
+                    log_anav_usage(args[0]);
+                    exit(1);
+                }
+                break;
+            case 'z':
+                zygote_on = 1;
+                break;
+            default:
+                log_anav_usage(args[0]);
+                exit(1);
+        }
+    }
+
+    if (metrics_path != NULL){
+        if (metrics_open(metrics_path) == -1){
+            log_anav_open_error(metrics_path);
+            exit(1);
+        }
+        atexit(metrics_close);
+        metrics_on = 1;
+        log_anav_metrics(metrics_path, 0);
+    }
+    if (textfile_path != NULL){
+        if (metrics_textfile(textfile_path, interval) == -1){
+            log_anav_open_error(textfile_path);
+            exit(1);
+        }
+        metrics_on = 1;
+        log_anav_metrics(textfile_path, interval);
+    }
+
+    if (cache_dir != NULL){
+        if (cache_open(cache_dir, cache_max) == -1){
+            log_anav_open_error(cache_dir);
+            exit(1);
+        }
+        cache_on = 1;
+        log_anav_cache(cache_dir, cache_max, cache_stats()->entries);
+    }
+
+    if (predict_on){
+        if (predict_open(predict_path) == -1){
+            log_anav_open_error(predict_path);
+            exit(1);
+        }
+        if (predict_path != NULL) atexit(predict_save);
+        log_anav_predict(predict_path, predict_count(), queue_order);
+    }
+
+    if (replay_path != NULL){
+        replay_count = session_load(replay_path);
+        if (replay_count == -1){
+            log_anav_open_error(replay_path);
+            exit(1);
+        }
+        session_on = 1;
+    }
+    if (record_path != NULL){
+        if (session_record(record_path) == -1){
+            log_anav_open_error(record_path);
+            exit(1);
+        }
+        atexit(session_close);
+        session_on = 1;
+        log_anav_recording(record_path);
+    }
+    if (session_on) session_start(shell_start_ns);
+
+    if (group_slots == 0) group_slots = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* Fork the helper before the table and the journal make the shell big */
+    if (zygote_on){
+        zygote_pid = zygote_start(run_child);
+        if (zygote_pid == -1){
+            log_anav_open_error("zygote");
+            exit(1);
+        }
+        log_anav_zygote(zygote_pid);
+    }
+    /* Reaping through pidfds needs pidfd_open, checked on the shell itself */
+    if (shards_on){
+        fd = syscall(SYS_pidfd_open, getpid(), 0);
+        if (fd == -1 || shards_start(shards_on) == -1){
+            log_anav_open_error("shards");
+            exit(1);
+        }
+        close(fd);
+        log_anav_shards(shards_on);
+    }
+    /* Shards take exits off SIGCHLD's path already, the ring takes all of it */
+    if (uring_on && shards_on){
+        log_anav_usage(args[0]);
+        exit(1);
+    }
+    if (uring_on){
+        if (uring_start(4096) == -1){
+            log_anav_open_error("io_uring");
+            exit(1);
+        }
+        log_anav_uring();
+    }
+
+    list = calloc(list_size, sizeof(Task*));
+    if (list == NULL) exit(1);
+    mem_add(MEM_TABLE, list_size*sizeof(Task*));
+    if (journal_path != NULL) restore(journal_path);
+
+    /* Handled signals stay blocked and are taken in event_wait() */
+    sigemptyset(&shell_mask);
+    sigaddset(&shell_mask, SIGINT);
+    sigaddset(&shell_mask, SIGTSTP);
+    /* With io_uring on, SIGCHLD keeps its default action and is discarded */
+    if (!uring_on) sigaddset(&shell_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &shell_mask, NULL);
+    sa.sa_handler = handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTSTP, &sa, NULL);
+    if (!uring_on) sigaction(SIGCHLD, &sa, NULL);
+
+    /* Unbuffered, so a line polled as readable is never left in stdio's buffer */
+    setvbuf(stdin, NULL, _IONBF, 0);
+
+    /* Intial Prompt and Welcome */
+    log_anav_intro();
+    log_anav_help();
+    log_anav_builtins();
+
+    if (replay_path != NULL){
+        log_anav_replay(replay_path, replay_count, replay_speed);
+        replay(replay_speed);
+        log_anav_quit();
+        return 0;
+    }
+
+  /* Shell looping here to accept user command and execute */
+    while (do_run_shell == RUN_SHELL) {
+        /* Print prompt */
+        log_anav_prompt();
+
+        /* Wait for input, following any task a resume brought to the foreground */
+        while (!event_wait(1)){
+            if (fg_resumed != NULL){
+                t = fg_resumed;
+                fg_resumed = NULL;
+                foreground(t);
+            }
+        }
+
+        /* Get Input - Allocates memory for the cmd copy */
+        cmd = get_input(); 
+        /* If the input is whitespace/invalid, get new input from the user. */
+        if(cmd == NULL) {
+          continue;
+        }
+
+        do_run_shell = run_command(cmd, NULL);
         cmd = NULL;
   }
 
@@ -0,0 +1,315 @@
+/* End-to-end scheduler benchmark for anav.
+ * - Starts ./anav with its stdin and output on pipes, types commands into it
+ *   and times the log lines it prints back.
+ * - Measures spawn latency (bg typed to Started logged), signal delivery
+ *   latency (suspend/resume typed to Stopped/Continued logged), reaping
+ *   throughput (a burst of short tasks until every one is reaped) and pipe
+ *   bandwidth (pipe_source piped into pipe_sink).
+ * - With BENCH_GROW=N set, spawn latency is measured again after N more
+ *   tasks have been added, to show how spawning scales with the shell's size
+ *   (compare a run with -z, the zygote, against one without).
+ * - With BENCH_THROTTLE=N set, a bursty foreground task runs beside N
+ *   background cpu_burn tasks, and its wakeup delay and wall time are
+ *   reported next to the work the burners got done (compare runs with and
+ *   without -t).
+ * - Extra arguments are passed on to anav, so anav's modes can be compared.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define TIMEOUT 30.0
+
+int to_anav = -1;
+int from_anav = -1;
+pid_t anav_pid = 0;
+int next_task = 1;
+char inbuf[1 << 16];
+size_t inlen = 0;
+char last_line[512];
+
+double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void start_anav(int argc, char *argv[]){
+    int in[2];
+    int out[2];
+    char **args = calloc(argc + 2, sizeof(char*));
+    if (args == NULL || pipe(in) == -1 || pipe(out) == -1){
+        perror("anav_bench");
+        exit(1);
+    }
+    args[0] = "./anav";
+    for (int i = 0; i < argc; i++) args[i+1] = argv[i];
+    anav_pid = fork();
+    if (anav_pid == 0){
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        close(in[1]);
+        close(out[0]);
+        execv(args[0], args);
+        perror("./anav");
+        _exit(1);
+    }
+    close(in[0]);
+    close(out[1]);
+    to_anav = in[1];
+    from_anav = out[0];
+    free(args);
+}
+
+/* Types one command line into anav */
+void send_cmd(const char *fmt, ...){
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    strcat(line, "\n");
+    if (write(to_anav, line, strlen(line)) < 0){
+        perror("anav_bench");
+        exit(1);
+    }
+}
+
+/* Reads anav's output until a line contains both needles (the second may be
+ * NULL) and returns the time it arrived, or -1 on timeout */
+double wait_line(const char *a, const char *b){
+    double deadline = now() + TIMEOUT;
+    struct pollfd p = {from_anav, POLLIN, 0};
+    char *nl = NULL;
+    ssize_t n = 0;
+    while (1){
+        while ((nl = memchr(inbuf, '\n', inlen)) != NULL){
+            *nl = '\0';
+            int found = strstr(inbuf, a) != NULL && (b == NULL || strstr(inbuf, b) != NULL);
+            if (found){
+                size_t len = nl - inbuf < sizeof(last_line) - 1 ? nl - inbuf : sizeof(last_line) - 1;
+                memcpy(last_line, inbuf, len);
+                last_line[len] = '\0';
+            }
+            inlen -= nl + 1 - inbuf;
+            memmove(inbuf, nl + 1, inlen);
+            if (found) return now();
+        }
+        if (now() > deadline || poll(&p, 1, 100) < 0) {
+            if (now() > deadline) return -1;
+            continue;
+        }
+        if (!(p.revents & (POLLIN | POLLHUP))) continue;
+        n = read(from_anav, inbuf + inlen, sizeof(inbuf) - inlen - 1);
+        if (n <= 0) return -1;
+        inlen += n;
+        if (inlen == sizeof(inbuf) - 1) inlen = 0;  /* drop an over-long line */
+    }
+}
+
+/* Adds a task and returns its task number */
+int add_task(const char *cmd){
+    char needle[32];
+    int num = next_task++;
+    send_cmd("%s", cmd);
+    snprintf(needle, sizeof(needle), "Task #%d:", num);
+    wait_line("Adding", needle);
+    return num;
+}
+
+int cmp_double(const void *a, const void *b){
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void report(const char *name, double *v, int n){
+    double sum = 0;
+    int ok = 0;
+    for (int i = 0; i < n; i++){
+        if (v[i] >= 0){
+            v[ok++] = v[i];
+            sum += v[i];
+        }
+    }
+    if (ok == 0){
+        printf("%-22s no samples\n", name);
+        return;
+    }
+    qsort(v, ok, sizeof(double), cmp_double);
+    printf("%-22s n=%-5d mean %8.1f us  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name, ok,
+           sum / ok * 1e6, v[ok/2] * 1e6, v[(int)(ok*0.99)] * 1e6, v[ok-1] * 1e6);
+}
+
+void bench_spawn(const char *name, int runs){
+    char needle[32];
+    double *lat = calloc(runs, sizeof(double));
+    int task = add_task("my_echo 0");
+    double t = 0;
+    snprintf(needle, sizeof(needle), "(Task %d)", task);
+    for (int i = 0; i < runs; i++){
+        t = now();
+        send_cmd("bg %d", task);
+        lat[i] = wait_line(needle, "(Started)") - t;
+        wait_line(needle, "(Terminated");
+    }
+    report(name, lat, runs);
+    free(lat);
+}
+
+/* suspend and resume go through anav's commands; resuming makes the task the
+ * foreground task, which a Ctrl-Z sent to anav then stops again. The task is
+ * continued behind anav's back after that, so the shell keeps reading. */
+void bench_signal(int runs){
+    char needle[32];
+    double *stop = calloc(runs, sizeof(double));
+    double *cont = calloc(runs, sizeof(double));
+    double *ctrl_z = calloc(runs, sizeof(double));
+    int task = add_task("cpu_burn 600 5");
+    int pid = 0;
+    double t = 0;
+    snprintf(needle, sizeof(needle), "(Task %d)", task);
+    send_cmd("bg %d", task);
+    wait_line(needle, "(Started)");
+    sscanf(strstr(last_line, "Process ") + strlen("Process "), "%d", &pid);
+    for (int i = 0; i < runs; i++){
+        t = now();
+        send_cmd("suspend %d", task);
+        stop[i] = wait_line(needle, "(Stopped)") - t;
+        t = now();
+        send_cmd("resume %d", task);
+        cont[i] = wait_line(needle, "(Continued)") - t;
+        t = now();
+        kill(anav_pid, SIGTSTP);
+        ctrl_z[i] = wait_line(needle, "(Stopped)") - t;
+        kill(pid, SIGCONT);
+        wait_line(needle, "(Continued)");
+    }
+    send_cmd("kill %d", task);
+    wait_line(needle, "(Terminated");
+    report("suspend->stopped", stop, runs);
+    report("resume->continued", cont, runs);
+    report("ctrl-z->stopped", ctrl_z, runs);
+    free(stop);
+    free(cont);
+    free(ctrl_z);
+}
+
+/* Adds tasks that never run, in batches small enough that anav's replies
+ * never fill the pipe while commands are still being written */
+void bench_grow(int tasks){
+    char needle[32];
+    double t = now();
+    int n = 0;
+    for (int i = 0; i < tasks; i += n){
+        n = tasks - i < 1000 ? tasks - i : 1000;
+        for (int k = 0; k < n; k++) send_cmd("my_echo %d", k);
+        next_task += n;
+        snprintf(needle, sizeof(needle), "Task #%d:", next_task - 1);
+        wait_line("Adding", needle);
+    }
+    printf("%-22s %d tasks in %.3f s\n", "table grown", tasks, now() - t);
+}
+
+void bench_reap(int tasks){
+    int first = 0;
+    int reaped = 0;
+    double t = 0;
+    double end = 0;
+    for (int i = 0; i < tasks; i++){
+        int num = add_task("my_echo 0");
+        if (i == 0) first = num;
+    }
+    t = now();
+    for (int i = 0; i < tasks; i++) send_cmd("bg %d", first + i);
+    for (reaped = 0; reaped < tasks; reaped++){
+        if ((end = wait_line("Terminated", NULL)) < 0) break;
+    }
+    printf("%-22s %d of %d tasks in %.3f s (%.0f tasks/s)\n", "reaping throughput", reaped, tasks,
+           end - t, reaped / (end - t));
+}
+
+void bench_pipe(int mb){
+    char cmd[64];
+    int src = 0;
+    int sink = 0;
+    snprintf(cmd, sizeof(cmd), "pipe_source %d", mb);
+    src = add_task(cmd);
+    sink = add_task("pipe_sink");
+    send_cmd("pipe %d %d", src, sink);
+    if (wait_line("pipe_sink:", NULL) < 0){
+        printf("%-22s no result\n", "pipe bandwidth");
+        return;
+    }
+    printf("%-22s %s\n", "pipe bandwidth", strstr(last_line, "pipe_sink:") + strlen("pipe_sink: "));
+}
+
+/* Runs bursty in the foreground while burners background cpu_burn tasks
+ * run out their time */
+void bench_throttle(int burners){
+    long long iterations = 0;
+    long long n = 0;
+    double t = 0;
+    double end = 0;
+    int first = 0;
+    int fg = 0;
+    int done = 0;
+    for (int i = 0; i < burners; i++){
+        int num = add_task("cpu_burn 4");
+        if (i == 0) first = num;
+    }
+    fg = add_task("bursty 100 2 20");
+    for (int i = 0; i < burners; i++) send_cmd("bg %d", first + i);
+    t = now();
+    send_cmd("exec %d", fg);
+    if ((end = wait_line("bursty:", NULL)) < 0){
+        printf("%-22s no result\n", "foreground");
+        return;
+    }
+    printf("%-22s %.3f s, %s\n", "foreground", end - t, strstr(last_line, "wakeup"));
+    for (done = 0; done < burners; done++){
+        if (wait_line("cpu_burn:", NULL) < 0) break;
+        if (sscanf(strstr(last_line, "cpu_burn:"), "cpu_burn: %lld", &n) == 1) iterations += n;
+    }
+    printf("%-22s %d burners, %lld iterations\n", "background work", done, iterations);
+}
+
+int main(int argc, char *argv[]){
+    int runs = 200;
+    int grow = 0;
+    int throttle = 0;
+    int status = 0;
+    char *env = getenv("BENCH_RUNS");
+
+    if (env != NULL) runs = atoi(env);
+    if ((env = getenv("BENCH_GROW")) != NULL) grow = atoi(env);
+    if ((env = getenv("BENCH_THROTTLE")) != NULL) throttle = atoi(env);
+    signal(SIGPIPE, SIG_IGN);
+    start_anav(argc - 1, argv + 1);
+    wait_line("Brackets", NULL);
+
+    bench_spawn("spawn latency", runs);
+    bench_signal(runs / 2);
+    bench_reap(runs * 5);
+    bench_pipe(512);
+    if (grow > 0){
+        bench_grow(grow);
+        bench_spawn("spawn latency (grown)", runs);
+    }
+    if (throttle > 0) bench_throttle(throttle);
+
+    send_cmd("quit");
+    close(to_anav);
+    waitpid(anav_pid, &status, 0);
+    return 0;
+}
@@ -0,0 +1,495 @@
+/* Log output of the shell's own features, beside the provided logging.c.
+ * Lines go out the same way and in the same colour as the provided ones,
+ * and every line is bounded by BUFSIZE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "anav_log.h"
+
+#define BUFSIZE 255
+
+#define anav_log(s) fprintf(stderr,"\033[1;31m%s%s\033[0m",log_anav_head, s); fflush(stderr)
+
+#define anav_write(s) char output[BUFSIZE] = {0}; snprintf(output,BUFSIZE-1,"\033[1;31m%s%s\033[0m", log_anav_head, s); write(STDERR_FILENO, output, strlen(output));
+
+static const char *log_anav_head = "[ANAV-LOG] ";
+static const char *task_state[] = { "Ready", "Running", "Suspended", "Finished", "Killed", NULL };
+
+/* Outputs the built-ins added on top of the provided ones, after
+ * log_anav_help() */
+void log_anav_builtins() {
+  anav_log("More Built-In Instructions:\n");
+  anav_log("    after TASK [DEP...] [ok] [<INFILE] [>OUTFILE],\n");
+  anav_log("    list [--graph], latency [on|off|reset], tail TASK [N],\n");
+  anav_log("    bench TASK RUNS [warmup N] [par N], meminfo, cache,\n");
+  anav_log("    hedge [TASK [off]], group [NAME [weight W] [TASK...]], top [SECS],\n");
+  anav_log("    wait [any|all] [TASK...] [timeout SECS]\n");
+  anav_log("\n");
+  anav_log("Prefix a program named like a built-in with \\ to add it as a task (\\top)\n");
+}
+
+/* Outputs the command line options */
+void log_anav_usage(const char *prog) {
+  char buffer[BUFSIZE*2] = {0};
+  snprintf(buffer, sizeof(buffer), "Usage: %s [-c BYTES] [-C DIR [-K BYTES]] [-e uring|signal] [-g SLOTS] [-H PCT] [-j JOURNAL] [-l] [-m SLOTS] [-M SOCKET] [-p FILE] [-q fifo|sjf|finish] [-r FILE] [-R FILE [-X SPEED]] [-w FILE [-i SECS]] [-s SOCKET] [-S SHARDS] [-t PCT|idle] [-x TRACEFILE] [-z]\n", prog);
+  anav_log(buffer);
+  anav_log("    -c BYTES      keep the last BYTES of each background task's output for tail\n");
+  anav_log("    -C DIR        cache results of tasks run with <INFILE and >OUTFILE in DIR\n");
+  anav_log("    -e BACKEND    watch children through io_uring or SIGCHLD (default signal)\n");
+  anav_log("    -g SLOTS      let SLOTS tasks of all groups run at once (default: online CPUs)\n");
+  anav_log("    -H PCT        race a duplicate of a hedged task past PCT of its siblings' runtimes\n");
+  anav_log("    -i SECS       rewrite the -w metrics file every SECS seconds (default 15)\n");
+  anav_log("    -j JOURNAL    journal the task table to JOURNAL and restore it on start\n");
+  anav_log("    -K BYTES      bound the -C cache to BYTES, evicting least recently used (default 1 GiB)\n");
+  anav_log("    -l            turn on latency instrumentation\n");
+  anav_log("    -m SLOTS      publish the task table in /dev/shm/anav.PID for anav_monitor\n");
+  anav_log("    -M SOCKET     serve OpenMetrics text on a UNIX-domain socket\n");
+  anav_log("    -p FILE       learn each command's runtime and keep the models in FILE\n");
+  anav_log("    -q ORDER      order group queues by fifo, sjf (predicted runtime) or finish (arrival plus it)\n");
+  anav_log("    -r FILE       record the session's commands, task runtimes and exit codes to FILE\n");
+  anav_log("    -R FILE       replay the session recorded in FILE, compare it with the recording and quit\n");
+  anav_log("    -s SOCKET     accept batched commands on a UNIX-domain control socket\n");
+  anav_log("    -S SHARDS     reap exits on SHARDS threads through pidfds\n");
+  anav_log("    -t PCT|idle   while a foreground task runs, run background tasks PCT% of the time, or at idle priority\n");
+  anav_log("    -w FILE       write OpenMetrics text to FILE for a textfile collector\n");
+  anav_log("    -x TRACEFILE  record finished tasks as an anav_sim workload trace\n");
+  anav_log("    -X SPEED      replay SPEED times as fast as recorded, 0 for as fast as possible (default 1)\n");
+  anav_log("    -z            spawn tasks from a zygote helper forked at startup\n");
+}
+
+/* Outputs a notification of an error opening one of the shell's own files */
+void log_anav_open_error(const char *file) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error opening file %s\n", file);
+  anav_log(buffer);
+}
+
+/* Outputs a notification that a grouped task cannot be piped */
+void log_anav_pipe_grouped(int task_num, const char *group) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Task #%d is in group %s and cannot be piped\n", task_num, group);
+  anav_log(buffer);
+}
+
+/* Output when a task is set to start after other tasks */
+void log_anav_after(int task_num, const char *deps, int on_success){
+  char buffer[BUFSIZE] = {0};
+  if (!deps || !*deps)
+  { snprintf(buffer, BUFSIZE, "Task #%d no longer waits on other tasks\n", task_num); }
+  else
+  { snprintf(buffer, BUFSIZE, "Task #%d will start after %s%s\n", task_num, deps, on_success ? " (exit code 0 required)" : ""); }
+  anav_log(buffer);
+}
+
+/* Output when a dependency would make a task wait on itself */
+void log_anav_after_cycle(int task_num, int dep) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Task #%d waiting on Task #%d would create a cycle\n", task_num, dep);
+  anav_log(buffer);
+}
+
+/* Output when a waiting task can no longer start.
+ * (Signal Handler Safe Outputting)
+ */
+void log_anav_dep_failed(int task_num) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task #%d will not start: a dependency did not finish successfully\n", task_num);
+  anav_write(buffer);
+}
+
+/* Output when no child could be forked for a task, which is left ready.
+ * (Signal Handler Safe Outputting)
+ */
+void log_anav_spawn_error(int task_num) {
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: Task #%d could not be started: fork failed\n", task_num);
+  anav_write(buffer);
+}
+
+/* Output the dependencies of a single task */
+void log_anav_task_deps(int task_num, const char *deps, int on_success, int waiting){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "    #%d <- %s%s%s\n", task_num, deps, on_success ? " (on success)" : "", waiting ? " (waiting)" : "");
+  anav_log(buffer);
+}
+
+/* Output where the shared-memory task table is published */
+void log_anav_shm(const char *name, int slots){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Publishing the task table in /dev/shm%s (%d slots)\n", name, slots);
+  anav_log(buffer);
+}
+
+/* Output the per-task cap on captured output */
+void log_anav_capture(int bytes){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Capturing background task output, up to %d bytes per task\n", bytes);
+  anav_log(buffer);
+}
+
+/* Output the header printed before a task's captured output */
+void log_anav_tail(int task_num, long long total, long long dropped){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Output of Task #%d (%lld bytes written, %lld dropped)\n", task_num, total, dropped);
+  anav_log(buffer);
+}
+
+/* Output what was rebuilt from the journal */
+void log_anav_journal(const char *path, int tasks, int adopted, double ms){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Restored %d task(s) from the journal %s in %.1f ms, %d still running\n", tasks, path, ms, adopted);
+  anav_log(buffer);
+}
+
+/* Output whether a task running before a restart was taken back */
+void log_anav_adopt(int task_num, int pid, int alive){
+  char buffer[BUFSIZE] = {0};
+  if (alive) snprintf(buffer, BUFSIZE, "Re-adopted Task #%d (PID %d)\n", task_num, pid);
+  else snprintf(buffer, BUFSIZE, "Task #%d (PID %d) did not survive the restart\n", task_num, pid);
+  anav_log(buffer);
+}
+
+/* Output the pid of the zygote helper */
+void log_anav_zygote(int pid){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Spawning tasks through the zygote helper (PID %d)\n", pid);
+  anav_log(buffer);
+}
+
+/* Output where metrics are served, secs is 0 for a socket */
+void log_anav_metrics(const char *path, int secs){
+  char buffer[BUFSIZE] = {0};
+  if (secs == 0) snprintf(buffer, BUFSIZE, "Serving metrics on the socket %s\n", path);
+  else snprintf(buffer, BUFSIZE, "Writing metrics to %s every %d s\n", path, secs);
+  anav_log(buffer);
+}
+
+/* Output the number of shard threads */
+void log_anav_shards(int n){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Reaping exits on %d shard thread(s)\n", n);
+  anav_log(buffer);
+}
+
+/* Output that children are watched through io_uring */
+void log_anav_uring(){
+  anav_log("Watching children through io_uring\n");
+}
+
+/* Output where the control socket listens */
+void log_anav_ctl(const char *path){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Accepting commands on the control socket %s\n", path);
+  anav_log(buffer);
+}
+
+/* Output the start of a bench */
+void log_anav_bench(int task_num, const char *cmd, int runs, int warmup, int par){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Benchmarking Task #%d: %s (%d runs after %d warmup, %d at a time)\n", task_num, cmd, runs, warmup, par);
+  anav_log(buffer);
+}
+
+/* Output how many bench runs were measured */
+void log_anav_bench_done(int runs, int failed, double secs){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%d run(s) measured in %.3f s, %d failed\n", runs, secs, failed);
+  anav_log(buffer);
+}
+
+/* Output the summary of one bench measure */
+void log_anav_bench_stat(const char *name, const char *unit, double mean, double sd, double min, double p50, double p95, double p99, double max, int outliers){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%-7s mean %9.2f  sd %9.2f  min %9.2f  p50 %9.2f  p95 %9.2f  p99 %9.2f  max %9.2f %-3s  outliers %d\n",
+          name, mean, sd, min, p50, p95, p99, max, unit, outliers);
+  anav_log(buffer);
+}
+
+/* Output that a process of a task's tree was re-parented to the shell */
+void log_anav_orphan(int task_num, int pid){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Adopted orphaned process %d of Task #%d\n", pid, task_num);
+  anav_log(buffer);
+}
+
+/* Output the orphans of a task still running, under its list entry */
+void log_anav_task_orphans(int task_num, int orphans){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "    #%d has %d orphaned process(es) running\n", task_num, orphans);
+  anav_log(buffer);
+}
+
+/* Output a task's predicted runtime beside the one it took or has taken so
+ * far, in seconds */
+void log_anav_task_runtime(int task_num, double predicted, double sd, double runtime, int status){
+  char buffer[BUFSIZE] = {0};
+  if (status == LOG_STATE_FINISHED || status == LOG_STATE_KILLED)
+    snprintf(buffer, BUFSIZE, "    #%d predicted %.3f s (sd %.3f), took %.3f s\n", task_num, predicted, sd, runtime);
+  else if (status == LOG_STATE_READY) snprintf(buffer, BUFSIZE, "    #%d predicted %.3f s (sd %.3f)\n", task_num, predicted, sd);
+  else snprintf(buffer, BUFSIZE, "    #%d predicted %.3f s (sd %.3f), %.3f s so far\n", task_num, predicted, sd, runtime);
+  anav_log(buffer);
+}
+
+/* Output the usage of bench */
+void log_anav_bench_usage(){
+  anav_log("Usage: bench TASK RUNS [warmup N] [par N]\n");
+}
+
+/* Output the usage of wait */
+void log_anav_wait_usage(){
+  anav_log("Usage: wait [any|all] [TASK|FIRST-LAST...] [timeout SECS]\n");
+}
+
+/* Output the set a wait blocks on, timeout 0 for none */
+void log_anav_wait(int count, int any, double timeout){
+  char buffer[BUFSIZE] = {0};
+  if (timeout > 0) snprintf(buffer, BUFSIZE, "Waiting for %s %d task(s) for up to %.1f s\n", any ? "any of" : "all", count, timeout);
+  else snprintf(buffer, BUFSIZE, "Waiting for %s %d task(s)\n", any ? "any of" : "all", count);
+  anav_log(buffer);
+}
+
+/* Output how a task a wait covered ended */
+void log_anav_wait_task(int task_num, int status, int exit_code){
+  char buffer[BUFSIZE] = {0};
+  if (status == LOG_STATE_KILLED) snprintf(buffer, BUFSIZE, "Task #%d: %s\n", task_num, task_state[status]);
+  else snprintf(buffer, BUFSIZE, "Task #%d: %s; exit code %d\n", task_num, task_state[status], exit_code);
+  anav_log(buffer);
+}
+
+/* Output how a wait ended: 0 when its tasks did, 1 on its timeout and 2 on
+ * a keyboard signal */
+void log_anav_wait_done(int ended, int count, int why){
+  static const char *whys[] = {"finished", "timed out", "interrupted"};
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Wait %s: %d of %d task(s) ended\n", whys[why], ended, count);
+  anav_log(buffer);
+}
+
+/* Output the usage of top */
+void log_anav_top_usage(){
+  anav_log("Usage: top [SECS]\n");
+}
+
+/* Output one category of the shell's own memory */
+void log_anav_meminfo(const char *name, long long blocks, long long bytes, long long peak){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%-9s %9lld block(s) %12lld bytes   peak %12lld bytes\n", name, blocks, bytes, peak);
+  anav_log(buffer);
+}
+
+/* Output the accounted total against the allocator's and the kernel's view */
+void log_anav_meminfo_total(long long accounted, long long per_task, long long heap_used, long long heap, long long rss){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "accounted %lld bytes (%lld per task); heap %lld in use of %lld; RSS %lld\n",
+          accounted, per_task, heap_used, heap, rss);
+  anav_log(buffer);
+}
+
+/* Output that the result cache is in use */
+void log_anav_cache(const char *dir, long long max_bytes, long long entries){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Caching task results in %s, up to %lld bytes, %lld entries found\n", dir, max_bytes, entries);
+  anav_log(buffer);
+}
+
+/* Output a task finished from the cache instead of running */
+void log_anav_cache_hit(int task_num, const char *cmd, const char *outfile, int exit_code){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task %d (%s) restored %s from the cache, exit code %d\n", task_num, cmd, outfile, exit_code);
+  anav_log(buffer);
+}
+
+/* Output the result cache's counters */
+void log_anav_cache_stats(long long hits, long long misses, long long stores, long long evictions, long long entries, long long bytes, long long max_bytes){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "cache: %lld hit(s), %lld miss(es), %lld store(s), %lld eviction(s); %lld entries, %lld of %lld bytes\n",
+          hits, misses, stores, evictions, entries, bytes, max_bytes);
+  anav_log(buffer);
+}
+
+/* Output that cache was typed without -C */
+void log_anav_cache_off(){
+  anav_log("The result cache is off, start anav with -C DIR\n");
+}
+
+/* Output that straggling hedged tasks are raced */
+void log_anav_hedging(double pct){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Hedging tasks that run past the p%g of their siblings' runtimes\n", pct);
+  anav_log(buffer);
+}
+
+/* Output that a task was marked or unmarked for hedging */
+void log_anav_hedge(int task_num, int on){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task #%d is %s\n", task_num, on ? "hedged from its next start" : "no longer hedged");
+  anav_log(buffer);
+}
+
+/* Output a duplicate started to race a straggler */
+void log_anav_hedge_launch(int task_num, int pid, double pct, double ms){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task #%d passed the p%g of its siblings at %.1f ms, racing duplicate process %d\n", task_num, pct, ms, pid);
+  anav_log(buffer);
+}
+
+/* Output which attempt of a hedged task finished first */
+void log_anav_hedge_won(int task_num, int duplicate, int pid, int loser, double ms){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task #%d: %s process %d won after %.1f ms, killing process %d\n",
+          task_num, duplicate ? "duplicate" : "original", pid, ms, loser);
+  anav_log(buffer);
+}
+
+/* Output a duplicate collected after it lost or failed */
+void log_anav_hedge_reaped(int task_num, int pid, int failed, double ms){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task #%d: %s process %d ended after %.1f ms\n", task_num,
+          failed ? "failed duplicate" : "losing", pid, ms);
+  anav_log(buffer);
+}
+
+/* Output how the hedging policy has fared */
+void log_anav_hedge_stats(double pct, long long launched, long long won, long long lost, long long dropped, double rate){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "hedge p%g: %lld duplicate(s) started, %lld won, %lld lost, %lld failed; win rate %.1f%%\n",
+          pct, launched, won, lost, dropped, rate);
+  anav_log(buffer);
+}
+
+/* Output that hedge was typed without -H */
+void log_anav_hedge_off(){
+  anav_log("Hedging is off, start anav with -H PCT\n");
+}
+
+/* Output a group's weight and size after group */
+void log_anav_group(const char *name, int weight, int members){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Group %s: weight %d, %d task(s)\n", name, weight, members);
+  anav_log(buffer);
+}
+
+/* Output the groups' header */
+void log_anav_groups(int count, int slots){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%d group(s) sharing %d slot(s)\n", count, slots);
+  anav_log(buffer);
+}
+
+/* Output one group's slots, queue and usage */
+void log_anav_group_info(const char *name, int weight, int running, int queued, double cpu, double slot_secs, double share){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Group %-16s weight %3d  running %3d  queued %4d  cpu %9.2f s  slots %9.2f s (%.1f%%)\n",
+           name, weight, running, queued, cpu, slot_secs, share);
+  anav_log(buffer);
+}
+
+/* Output that a task waits for a slot of its group */
+void log_anav_group_queued(int task_num, const char *name, int queued){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Task #%d queued in group %s (%d waiting)\n", task_num, name, queued);
+  anav_log(buffer);
+}
+
+/* Output the group a task is queued in, under it in list */
+void log_anav_task_queued(int task_num, const char *name){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "    #%d queued in group %s\n", task_num, name);
+  anav_log(buffer);
+}
+
+/* Output why a group cannot be made or take tasks */
+void log_anav_group_error(const char *name, const char *why){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Error: group %s %s\n", name, why);
+  anav_log(buffer);
+}
+
+/* Output the usage of group */
+void log_anav_group_usage(){
+  anav_log("Usage: group [NAME[/SUBGROUP...] [weight W] [TASK...]]\n");
+}
+
+/* Output how background tasks are held back while a foreground task runs */
+void log_anav_throttle(int duty){
+  char buffer[BUFSIZE] = {0};
+  if (duty > 0) snprintf(buffer, BUFSIZE, "Running background tasks %d%% of the time while a foreground task runs\n", duty);
+  else snprintf(buffer, BUFSIZE, "Running background tasks at idle priority while a foreground task runs\n");
+  anav_log(buffer);
+}
+
+/* Output the runtime models in use and how group queues are ordered */
+void log_anav_predict(const char *path, int models, int order){
+  static const char *orders[] = {"arrival", "predicted runtime", "predicted finish"};
+  char buffer[BUFSIZE] = {0};
+  if (path != NULL) snprintf(buffer, BUFSIZE, "Predicting runtimes from %d model(s) in %s; group queues by %s\n", models, path, orders[order]);
+  else snprintf(buffer, BUFSIZE, "Predicting runtimes from this session's runs; group queues by %s\n", orders[order]);
+  anav_log(buffer);
+}
+
+/* Output where the session is recorded */
+void log_anav_recording(const char *path){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Recording the session to %s\n", path);
+  anav_log(buffer);
+}
+
+/* Output the recording being replayed, speed 0 for as fast as possible */
+void log_anav_replay(const char *path, int commands, double speed){
+  char buffer[BUFSIZE] = {0};
+  if (speed > 0) snprintf(buffer, BUFSIZE, "Replaying %d command(s) from %s at %gx speed\n", commands, path, speed);
+  else snprintf(buffer, BUFSIZE, "Replaying %d command(s) from %s as fast as possible\n", commands, path);
+  anav_log(buffer);
+}
+
+/* Output a replayed command after the prompt, in place of a typed one */
+void log_anav_replay_command(const char *cmd){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Replaying: %s\n", cmd);
+  anav_log(buffer);
+}
+
+/* Output one measure of the replay beside the recording's */
+void log_anav_replay_stat(const char *name, const char *unit, double recorded, double replayed){
+  char buffer[BUFSIZE] = {0};
+  if (recorded > 0) snprintf(buffer, BUFSIZE, "%-16s recorded %10.1f  replayed %10.1f %-7s %+7.1f%%\n", name, recorded, replayed, unit, 100.0 * (replayed - recorded) / recorded);
+  else snprintf(buffer, BUFSIZE, "%-16s recorded %10.1f  replayed %10.1f %s\n", name, recorded, replayed, unit);
+  anav_log(buffer);
+}
+
+/* Output the tasks the replay ran against the recording */
+void log_anav_replay_done(long long recorded, long long replayed, long long mismatches){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Replay finished: %lld of %lld recorded task(s) ended, %lld with another exit code\n", replayed, recorded, mismatches);
+  anav_log(buffer);
+}
+
+/* Output whether latency instrumentation is on */
+void log_anav_latency_state(int on){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "Latency instrumentation is %s\n", on ? "on" : "off");
+  anav_log(buffer);
+}
+
+/* Output the summary of one latency phase, times in microseconds */
+void log_anav_latency_phase(const char *phase, long long count, double mean, double p50, double p90, double p99, double p999, double max){
+  char buffer[BUFSIZE] = {0};
+  snprintf(buffer, BUFSIZE, "%-16s n=%-7lld mean %9.1f  p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n",
+          phase, count, mean, p50, p90, p99, p999, max);
+  anav_log(buffer);
+}
+
+/* Output one histogram bar, bounds in microseconds */
+void log_anav_latency_bar(double low, double high, long long count, int width){
+  char buffer[BUFSIZE] = {0};
+  char bar[41] = {0};
+  if (width < 0) width = 0;
+  if (width > 40) width = 40;
+  memset(bar, '#', width);
+  snprintf(buffer, BUFSIZE, "    [%10.1f, %10.1f) %8lld %s\n", low, high, count, bar);
+  anav_log(buffer);
+}
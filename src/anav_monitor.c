@@ -0,0 +1,79 @@
+/* Reader for anav's shared-memory task table.
+ * - Maps /dev/shm/anav.<pid> read-only and prints every task's state, pid,
+ *   exit code and timings, without any syscall into the shell.
+ * - Usage: anav_monitor [-i INTERVAL_MS] [-n COUNT] SHELL_PID
+ *   prints the table COUNT times (default once), INTERVAL_MS apart.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shm_table.h"
+#include "logging.h"
+#include "clock.h"
+
+static const char *states[] = {"Ready", "Running", "Suspended", "Finished", "Killed"};
+
+void print_table(const ShmHeader *hdr){
+    ShmEntry e;
+    uint32_t high = __atomic_load_n(&hdr->high_water, __ATOMIC_ACQUIRE);
+    long long now = now_ns();
+    double run_ms = 0;
+    int counts[5] = {0};
+
+    printf("%6s %8s %-10s %5s %12s %10s  %s\n", "TASK", "PID", "STATE", "EXIT", "RUNTIME_MS", "CPU_MS", "COMMAND");
+    for (uint32_t i = 0; i < high && i < hdr->capacity; i++){
+        shm_table_read(hdr, i, &e);
+        if (e.task_num == 0 || e.state < 0 || e.state > 4) continue;
+        counts[e.state]++;
+        run_ms = 0;
+        if (e.start_ns != 0) run_ms = ((e.end_ns != 0 ? e.end_ns : now) - e.start_ns) / 1e6;
+        printf("%6d %8d %-10s %5d %12.1f %10.1f  %s\n", e.task_num, e.pid, states[e.state],
+               e.exit_code, run_ms, e.cpu_us / 1e3, e.cmd);
+    }
+    printf("shell %d: generation %llu, %d ready, %d running, %d suspended, %d finished, %d killed",
+           hdr->shell_pid, (unsigned long long)__atomic_load_n(&hdr->generation, __ATOMIC_ACQUIRE),
+           counts[LOG_STATE_READY], counts[LOG_STATE_RUNNING], counts[LOG_STATE_SUSPENDED],
+           counts[LOG_STATE_FINISHED], counts[LOG_STATE_KILLED]);
+    if (hdr->dropped) printf(", %llu updates beyond %u slots", (unsigned long long)hdr->dropped, hdr->capacity);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]){
+    char name[64] = "";
+    int interval_ms = 1000;
+    int count = 1;
+    int opt = 0;
+    const ShmHeader *hdr = NULL;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1){
+        switch (opt){
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-i INTERVAL_MS] [-n COUNT] SHELL_PID\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc){
+        fprintf(stderr, "Usage: %s [-i INTERVAL_MS] [-n COUNT] SHELL_PID\n", argv[0]);
+        return 1;
+    }
+    snprintf(name, sizeof(name), "/anav.%s", argv[optind]);
+    hdr = shm_table_map(name);
+    if (hdr == NULL){
+        fprintf(stderr, "%s: cannot map /dev/shm%s (is anav running with -m?)\n", argv[0], name);
+        return 1;
+    }
+    for (int i = 0; count <= 0 || i < count; i++){
+        if (i > 0){
+            usleep(interval_ms * 1000);
+            printf("\n");
+        }
+        print_table(hdr);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+/* Built-ins added on top of the provided parser's, see builtins.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/builtins.h"
+#include "../inc/util.h"
+
+static char *builtins[] = {"after", "latency", "tail", "bench", "meminfo", "cache", "hedge", "group", "top", "wait", NULL};
+
+// built-ins which may use a Task Number argument
+static char *builtins_with_id1[] = {"after", "tail", "bench", "hedge", NULL};
+
+// built-ins which may use filename arguments
+static char *builtins_with_file[] = {"after", NULL};
+
+// built-ins which take no arguments, so argv is cleared
+static char *builtins_without_args[] = {"meminfo", "cache", NULL};
+
+static int contains(const char *needle, char *haystack[]){
+    int i = 0;
+    if (needle == NULL) return 0;
+    for (i=0;haystack[i]!=NULL;i++){
+        if (strcmp(needle, haystack[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+/* Copies the file name of the redirect at toks[0], which is the rest of the
+ * token or the next one. Returns the token after it. */
+static char **redirect_file(char **toks, char **file){
+    const char *name = toks[0] + 1;
+    if (*name == '\0'){
+        toks++;
+        name = toks[0];
+        if (name == NULL) return toks;
+    }
+    free(*file);
+    *file = string_copy(name);
+    return toks + 1;
+}
+
+/* Drops the first character of s */
+static void drop_first(char *s){
+    memmove(s, s + 1, strlen(s));
+}
+
+void builtin_parse(Instruction *inst, char *argv[]){
+    char *end = NULL;
+    char **toks = NULL;
+    if (inst->instruct == NULL) return;
+    /* The instruction keeps its backslash, so it matches no built-in */
+    if (inst->instruct[0] == '\\' && inst->instruct[1] != '\0'){
+        drop_first(argv[0]);
+        return;
+    }
+    if (!contains(inst->instruct, builtins)) return;
+    if (contains(inst->instruct, builtins_with_id1) && argv[1] != NULL){
+        inst->id1 = (int)strtol(argv[1], &end, 10);
+        if (*end != '\0' || end == argv[1]) inst->id1 = 0;
+    }
+    if (contains(inst->instruct, builtins_with_file) && argv[1] != NULL){
+        toks = argv + 2;
+        while (*toks != NULL){
+            if ((*toks)[0] == '<') toks = redirect_file(toks, &inst->infile);
+            else if ((*toks)[0] == '>') toks = redirect_file(toks, &inst->outfile);
+            else toks++;
+        }
+    }
+    if (contains(inst->instruct, builtins_without_args)) free_argv_str(argv);
+}
+
+char *builtin_command(char *cmd_line){
+    char *p = cmd_line + strspn(cmd_line, " ");
+    return p[0] == '\\' && p[1] != '\0' && p[1] != ' ' ? p + 1 : cmd_line;
+}
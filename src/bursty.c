@@ -0,0 +1,48 @@
+/* A workload program provided as local executable.
+ * - Emulates an interactive program: N rounds (default 50) of a short CPU
+ *   burst (default 2ms) followed by think time (default 20ms).
+ * - Prints how late it woke up after each think time on average and at
+ *   worst, which grows when the CPU is contended.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+long long now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]){
+    int rounds = 50;
+    double burst_ms = 2;
+    double think_ms = 20;
+    long long t = 0;
+    long long late = 0;
+    long long total_late = 0;
+    long long max_late = 0;
+    volatile unsigned long x = 1;
+    struct timespec think = {0};
+
+    if (argc > 1) rounds = atoi(argv[1]);
+    if (argc > 2) burst_ms = atof(argv[2]);
+    if (argc > 3) think_ms = atof(argv[3]);
+    think.tv_sec = (time_t)(think_ms / 1000);
+    think.tv_nsec = (long)((think_ms - think.tv_sec*1000) * 1e6);
+
+    for (int r = 0; r < rounds; r++){
+        t = now_ns();
+        while (now_ns() - t < burst_ms * 1e6) x = x * 31 + 7;
+        t = now_ns();
+        nanosleep(&think, NULL);
+        late = now_ns() - t - (long long)(think_ms * 1e6);
+        total_late += late;
+        if (late > max_late) max_late = late;
+    }
+    printf("bursty: %d rounds, wakeup delay mean %.3f ms max %.3f ms\n", rounds,
+           rounds ? total_late / 1e6 / rounds : 0.0, max_late / 1e6);
+    return 0;
+}
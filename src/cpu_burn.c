@@ -0,0 +1,54 @@
+/* A workload program provided as local executable.
+ * - Burns CPU for the given number of seconds (default 5) at a target
+ *   duty cycle in percent (default 100), in 10ms periods.
+ * - Prints how many work iterations it completed, so background
+ *   throughput can be compared between runs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PERIOD_NS 10000000LL
+
+long long now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]){
+    double seconds = 5;
+    int duty = 100;
+    long long start = 0;
+    long long end = 0;
+    long long period_start = 0;
+    long long busy_ns = 0;
+    long long iterations = 0;
+    volatile unsigned long x = 1;
+    struct timespec idle = {0};
+
+    if (argc > 1) seconds = atof(argv[1]);
+    if (argc > 2) duty = atoi(argv[2]);
+    if (duty < 1) duty = 1;
+    if (duty > 100) duty = 100;
+    busy_ns = PERIOD_NS * duty / 100;
+
+    start = now_ns();
+    end = start + (long long)(seconds * 1e9);
+    while ((period_start = now_ns()) < end){
+        /* Busy part of the period */
+        while (now_ns() - period_start < busy_ns){
+            for (int i = 0; i < 1000; i++) x = x * 6364136223846793005UL + 1442695040888963407UL;
+            iterations++;
+        }
+        /* Idle for the rest of it */
+        if (duty < 100){
+            idle.tv_nsec = PERIOD_NS - (now_ns() - period_start);
+            if (idle.tv_nsec > 0) nanosleep(&idle, NULL);
+        }
+    }
+    printf("cpu_burn: %lld iterations in %.2f s at %d%% duty\n", iterations, (now_ns() - start) / 1e9, duty);
+    return 0;
+}
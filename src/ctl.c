@@ -0,0 +1,194 @@
+/* Control socket for programmatic task submission.
+ * - Clients are non-blocking and served from the shell's event loop, so a
+ *   request runs between two reaps and never while a signal is handled.
+ * - A client with reply bytes still unsent is not read from until they drain,
+ *   which keeps one slow reader from growing the shell without bound.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include "../inc/ctl.h"
+
+typedef struct client{
+    int fd;
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    Reply out;
+    size_t out_sent;
+} Client;
+
+static int listen_fd = -1;
+static char sock_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static Client clients[CTL_MAX_CLIENTS];
+static int num_clients = 0;
+
+static void reserve(Reply *r, size_t more){
+    if (r->len + more <= r->cap) return;
+    while (r->len + more > r->cap) r->cap = r->cap ? r->cap*2 : 4096;
+    r->data = realloc(r->data, r->cap);
+    if (r->data == NULL) exit(1);
+}
+
+void reply_add(Reply *r, const char *fmt, ...){
+    va_list args;
+    int n = 0;
+    if (r == NULL) return;
+    va_start(args, fmt);
+    n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    reserve(r, n + 2);
+    va_start(args, fmt);
+    vsnprintf(r->data + r->len, n + 1, fmt, args);
+    va_end(args);
+    r->len += n;
+    r->data[r->len++] = '\n';
+}
+
+int ctl_open(const char *path){
+    struct sockaddr_un addr = {0};
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) return -1;
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listen_fd, SOMAXCONN) == -1){
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    strcpy(sock_path, path);
+    return 0;
+}
+
+static void drop(Client *c){
+    close(c->fd);
+    free(c->in);
+    free(c->out.data);
+    *c = clients[--num_clients];
+    memset(&clients[num_clients], 0, sizeof(Client));
+}
+
+void ctl_close(){
+    if (listen_fd == -1) return;
+    while (num_clients > 0) drop(&clients[0]);
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(sock_path);
+}
+
+int ctl_fds(struct pollfd *fds, int max){
+    int n = 0;
+    int i = 0;
+    if (listen_fd == -1) return 0;
+    if (num_clients < CTL_MAX_CLIENTS && n < max){
+        fds[n++] = (struct pollfd){listen_fd, POLLIN, 0};
+    }
+    for (i=0;i<num_clients && n < max;i++){
+        fds[n++] = (struct pollfd){clients[i].fd, clients[i].out.len > 0 ? POLLOUT : POLLIN, 0};
+    }
+    return n;
+}
+
+/* Sends what it can of the pending reply. Returns -1 if the client is gone. */
+static int flush(Client *c){
+    ssize_t n = 0;
+    while (c->out_sent < c->out.len){
+        n = send(c->fd, c->out.data + c->out_sent, c->out.len - c->out_sent, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n == -1) return -1;
+        c->out_sent += n;
+    }
+    c->out.len = 0;
+    c->out_sent = 0;
+    return 0;
+}
+
+/* Runs every line of one request and frames the replies */
+static void run_request(Client *c, const char *payload, uint32_t len, ctl_command run){
+    char *copy = malloc(len + 1);
+    char *line = NULL;
+    char *next = NULL;
+    size_t start = c->out.len;
+    uint32_t size = 0;
+    if (copy == NULL) exit(1);
+    memcpy(copy, payload, len);
+    copy[len] = '\0';
+    reserve(&c->out, sizeof(size));
+    c->out.len += sizeof(size);
+    for (line = copy; line != NULL; line = next){
+        next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+        run(line, &c->out);
+    }
+    size = htonl(c->out.len - start - sizeof(size));
+    memcpy(c->out.data + start, &size, sizeof(size));
+    free(copy);
+}
+
+/* Reads what the client sent and runs each complete request.
+ * Returns -1 if the client is gone or broke the framing. */
+static int receive(Client *c, ctl_command run){
+    ssize_t n = 0;
+    uint32_t len = 0;
+    size_t used = 0;
+    if (c->in_cap - c->in_len < 4096){
+        c->in_cap = c->in_cap ? c->in_cap*2 : 65536;
+        c->in = realloc(c->in, c->in_cap);
+        if (c->in == NULL) exit(1);
+    }
+    n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+    if (n == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (n <= 0) return -1;
+    c->in_len += n;
+    while (c->in_len - used >= sizeof(len)){
+        memcpy(&len, c->in + used, sizeof(len));
+        len = ntohl(len);
+        if (len > CTL_MAX_FRAME) return -1;
+        if (c->in_len - used - sizeof(len) < len) break;
+        run_request(c, c->in + used + sizeof(len), len, run);
+        used += sizeof(len) + len;
+    }
+    c->in_len -= used;
+    memmove(c->in, c->in + used, c->in_len);
+    return flush(c);
+}
+
+void ctl_service(struct pollfd *fds, int n, ctl_command run){
+    int i = 0;
+    int k = 0;
+    int fd = -1;
+    int gone = 0;
+    Client *c = NULL;
+    for (i=0;i<n;i++){
+        if (fds[i].revents == 0) continue;
+        if (fds[i].fd == listen_fd){
+            while (num_clients < CTL_MAX_CLIENTS){
+                fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd == -1) break;
+                clients[num_clients++].fd = fd;
+            }
+            continue;
+        }
+        c = NULL;
+        for (k=0;k<num_clients;k++){
+            if (clients[k].fd == fds[i].fd) c = &clients[k];
+        }
+        if (c == NULL) continue;
+        if (fds[i].revents & POLLOUT) gone = flush(c);
+        else if (fds[i].revents & POLLIN) gone = receive(c, run);
+        else gone = -1;
+        if (gone == -1) drop(c);
+    }
+}
@@ -0,0 +1,53 @@
+/* A workload program provided as local executable.
+ * - Forks the given number of children (default 1000) that exit at once,
+ *   keeping at most the given number (default 64) alive at a time.
+ * - Prints the fork and reap rate.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+long long now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]){
+    int total = 1000;
+    int width = 64;
+    int started = 0;
+    int alive = 0;
+    long long start = 0;
+    double secs = 0;
+    pid_t pid = 0;
+
+    if (argc > 1) total = atoi(argv[1]);
+    if (argc > 2) width = atoi(argv[2]);
+    if (width < 1) width = 1;
+
+    start = now_ns();
+    while (started < total || alive > 0){
+        if (started < total && alive < width){
+            pid = fork();
+            if (pid == 0) _exit(0);
+            if (pid < 0){
+                perror("fork_storm");
+                total = started;
+                continue;
+            }
+            started++;
+            alive++;
+        }
+        else if (wait(NULL) > 0){
+            alive--;
+        }
+    }
+    secs = (now_ns() - start) / 1e9;
+    printf("fork_storm: %d children in %.3f s (%.0f forks/s)\n", total, secs, secs > 0 ? total / secs : 0.0);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* Log-linear histograms: see hist.h */
+
+#include <string.h>
+
+#include "hist.h"
+
+/* Index of the sub-bucket holding value */
+static int hist_index(long long value) {
+    int msb = 63 - __builtin_clzll((unsigned long long)value | 1);
+    int shift = msb - HIST_SUB_BITS;
+    if (shift <= 0) { return (int)value; }  // small values are counted exactly
+    return (shift + 1) * HIST_SUB + (int)((value >> shift) - HIST_SUB);
+}
+
+/* Largest value that falls in the sub-bucket at index */
+static long long hist_value(int index) {
+    int shift = index / HIST_SUB - 1;
+    long long sub = index % HIST_SUB;
+    if (shift <= 0) { return index; }
+    return ((HIST_SUB + sub + 1) << shift) - 1;
+}
+
+void hist_reset(Hist *h) {
+    memset(h, 0, sizeof(Hist));
+}
+
+void hist_record(Hist *h, long long value) {
+    if (value < 0) { value = 0; }
+    if (h->count == 0 || value < h->min) { h->min = value; }
+    if (value > h->max) { h->max = value; }
+    h->count++;
+    h->sum += value;
+    h->counts[hist_index(value)]++;
+}
+
+long long hist_percentile(const Hist *h, double percent) {
+    long long target = 0;
+    long long seen = 0;
+    if (h->count == 0) { return 0; }
+    target = (long long)(percent / 100.0 * h->count + 0.5);
+    if (target < 1) { target = 1; }
+    for (int i = 0; i < HIST_SIZE; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            long long v = hist_value(i);
+            return v > h->max ? h->max : v;  // never report beyond the true max
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const Hist *h) {
+    return h->count ? (double)h->sum / h->count : 0.0;
+}
+
+/* Exact when low and high are powers of two, since no sub-bucket spans one */
+long long hist_count_range(const Hist *h, long long low, long long high) {
+    long long n = 0;
+    if (low < 0) { low = 0; }
+    if (high <= low) { return 0; }
+    for (int i = hist_index(low); i < HIST_SIZE && hist_value(i) < high; i++) {
+        n += h->counts[i];
+    }
+    return n;
+}
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../inc/journal.h"
+
+#define JOURNAL_MAGIC   "ANAVJRN1"
+#define JOURNAL_INITIAL (1 << 20)
+#define JOURNAL_COMPACT (4 << 20)
+
+typedef struct jheader{
+    char magic[8];
+    uint64_t gen;
+} JHeader;
+
+static int jfd = -1;
+static char *map = NULL;
+static size_t map_size = 0;
+static size_t end = 0;
+static uint64_t gen = 0;
+static size_t snap_bytes = 0;
+static char jpath[4096];
+static char spath[4096];
+static char tpath[4096];
+static FILE *snap = NULL;
+
+static size_t padded(size_t n){
+    return (sizeof(JRecord) + n + 7) & ~(size_t)7;
+}
+
+/* Replays the records in buffer p of n bytes, stopping at the first one that
+ * is missing or torn. Returns the offset just past the last good record. */
+static size_t replay(const char *p, size_t n, size_t off, journal_fn fn){
+    JRecord r;
+    while (off + sizeof(JRecord) <= n){
+        memcpy(&r, p + off, sizeof(JRecord));
+        if (r.len < sizeof(JRecord) || r.len % 8 != 0 || r.len > n - off) break;
+        if (fn != NULL) fn(&r, p + off + sizeof(JRecord));
+        off += r.len;
+    }
+    return off;
+}
+
+/* Reads the snapshot, if any. Returns its generation, 0 if there is none. */
+static uint64_t load_snapshot(journal_fn fn){
+    struct stat st;
+    JHeader h;
+    char *buf = MAP_FAILED;
+    int fd = open(spath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(JHeader)){
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    }
+    close(fd);
+    if (buf == MAP_FAILED) return 0;
+    memcpy(&h, buf, sizeof(h));
+    if (memcmp(h.magic, JOURNAL_MAGIC, 8) != 0){
+        munmap(buf, st.st_size);
+        return 0;
+    }
+    replay(buf, st.st_size, sizeof(JHeader), fn);
+    snap_bytes = st.st_size;
+    munmap(buf, st.st_size);
+    return h.gen;
+}
+
+/* Zeroes the journal from offset off on by cutting the file short and
+ * growing it back, which drops the pages instead of writing over them */
+static void clear_from(size_t off){
+    if (ftruncate(jfd, off) == -1 || ftruncate(jfd, map_size) == -1){
+        memset(map + off, 0, map_size - off);
+    }
+}
+
+/* Empties the journal and stamps it with generation g */
+static void reset(uint64_t g){
+    JHeader h;
+    clear_from(sizeof(JHeader));
+    memcpy(h.magic, JOURNAL_MAGIC, 8);
+    h.gen = g;
+    memcpy(map, &h, sizeof(h));
+    gen = g;
+    end = sizeof(JHeader);
+}
+
+int journal_open(const char *path, journal_fn fn){
+    struct stat st;
+    JHeader h;
+    uint64_t snap_gen = 0;
+    if (strlen(path) + 6 > sizeof(jpath)) return -1;
+    strcpy(jpath, path);
+    snprintf(spath, sizeof(spath), "%s.snap", path);
+    snprintf(tpath, sizeof(tpath), "%s.tmp", path);
+    snap_gen = load_snapshot(fn);
+
+    jfd = open(jpath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (jfd == -1 || fstat(jfd, &st) == -1) return -1;
+    map_size = st.st_size < JOURNAL_INITIAL ? JOURNAL_INITIAL : st.st_size;
+    if (ftruncate(jfd, map_size) == -1) return -1;
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, jfd, 0);
+    if (map == MAP_FAILED){
+        map = NULL;
+        return -1;
+    }
+    memcpy(&h, map, sizeof(h));
+    /* Only records written since the snapshot are replayed */
+    if (memcmp(h.magic, JOURNAL_MAGIC, 8) != 0 || h.gen != snap_gen){
+        reset(snap_gen);
+        return 0;
+    }
+    gen = h.gen;
+    end = replay(map, map_size, sizeof(JHeader), fn);
+    /* Clear whatever a torn append left behind the last good record */
+    clear_from(end);
+    return 0;
+}
+
+/* Doubles the mapping until need bytes fit. Returns -1 if it cannot. */
+static int grow(size_t need){
+    size_t size = map_size;
+    char *p = NULL;
+    while (size < need) size *= 2;
+    if (ftruncate(jfd, size) == -1) return -1;
+    p = mremap(map, map_size, size, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED) return -1;
+    map = p;
+    map_size = size;
+    return 0;
+}
+
+void journal_append(const JRecord *r, const char *strings, size_t n){
+    uint32_t len = padded(n);
+    if (map == NULL) return;
+    if (end + len > map_size && grow(end + len) == -1) return;
+    memcpy(map + end + sizeof(uint32_t), (const char*)r + sizeof(uint32_t), sizeof(JRecord) - sizeof(uint32_t));
+    memcpy(map + end + sizeof(JRecord), strings, n);
+    /* The length goes in last, so a record cut short by a crash is never replayed */
+    __atomic_store_n((uint32_t*)(map + end), len, __ATOMIC_RELEASE);
+    end += len;
+}
+
+int journal_should_compact(){
+    return map != NULL && end > JOURNAL_COMPACT && end > snap_bytes;
+}
+
+int journal_snapshot_begin(){
+    JHeader h;
+    if (map == NULL) return -1;
+    snap = fopen(tpath, "we");
+    if (snap == NULL) return -1;
+    memcpy(h.magic, JOURNAL_MAGIC, 8);
+    h.gen = gen + 1;
+    fwrite(&h, sizeof(h), 1, snap);
+    snap_bytes = sizeof(h);
+    return 0;
+}
+
+void journal_snapshot_add(const JRecord *r, const char *strings, size_t n){
+    static const char zeros[8] = {0};
+    JRecord copy = *r;
+    if (snap == NULL) return;
+    copy.len = padded(n);
+    fwrite(&copy, sizeof(copy), 1, snap);
+    fwrite(strings, 1, n, snap);
+    fwrite(zeros, 1, copy.len - sizeof(copy) - n, snap);
+    snap_bytes += copy.len;
+}
+
+int journal_snapshot_end(){
+    int failed = 0;
+    if (snap == NULL) return -1;
+    failed = ferror(snap);
+    if (fclose(snap) != 0) failed = 1;
+    snap = NULL;
+    if (failed || rename(tpath, spath) == -1){
+        unlink(tpath);
+        return -1;
+    }
+    reset(gen + 1);
+    return 0;
+}
+
+void journal_close(){
+    if (map == NULL) return;
+    munmap(map, map_size);
+    close(jfd);
+    map = NULL;
+    jfd = -1;
+}
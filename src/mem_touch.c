@@ -0,0 +1,46 @@
+/* A workload program provided as local executable.
+ * - Allocates the given number of MiB (default 64) and writes to every
+ *   page, for the given number of passes (default 1).
+ * - Prints the time taken and the touch rate, to create and measure
+ *   memory pressure.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+long long now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]){
+    size_t mb = 64;
+    int passes = 1;
+    size_t size = 0;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t off = 0;
+    long long start = 0;
+    double secs = 0;
+    char *mem = NULL;
+
+    if (argc > 1) mb = strtoul(argv[1], NULL, 10);
+    if (argc > 2) passes = atoi(argv[2]);
+    size = mb << 20;
+    mem = malloc(size);
+    if (mem == NULL){
+        fprintf(stderr, "mem_touch: cannot allocate %zu MiB\n", mb);
+        return 1;
+    }
+
+    start = now_ns();
+    for (int p = 0; p < passes; p++){
+        for (off = 0; off < size; off += page) mem[off] = (char)(p + off);
+    }
+    secs = (now_ns() - start) / 1e9;
+    printf("mem_touch: %zu MiB x %d passes in %.3f s (%.1f MiB/s)\n", mb, passes, secs, secs > 0 ? mb * passes / secs : 0.0);
+    free(mem);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include "../inc/memstat.h"
+
+static MemStat stats[MEM_CATEGORIES];
+static const char *names[] = {"tasks", "table", "commands", "argv", "deps", "output", "index", "bench", "hedge"};
+
+void mem_resize(int cat, size_t old_size, size_t new_size){
+    MemStat *s = &stats[cat];
+    if (old_size == 0 && new_size > 0) s->blocks++;
+    if (old_size > 0 && new_size == 0) s->blocks--;
+    s->bytes += (long long)new_size - (long long)old_size;
+    if (s->bytes > s->peak) s->peak = s->bytes;
+}
+
+void mem_add(int cat, size_t size){
+    mem_resize(cat, 0, size);
+}
+
+void mem_sub(int cat, size_t size){
+    mem_resize(cat, size, 0);
+}
+
+const MemStat *mem_stat(int cat){
+    return &stats[cat];
+}
+
+const char *mem_name(int cat){
+    return names[cat];
+}
@@ -0,0 +1,235 @@
+/* OpenMetrics exporter, see metrics.h.
+ * - Socket clients are non-blocking and served from the shell's event loop
+ *   like control socket clients; each gets one rendering and is closed once
+ *   it has been sent.
+ * - The textfile is written on a timerfd tick, also from the event loop, so
+ *   it is rendered between two reaps like everything else.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/timerfd.h>
+#include "../inc/metrics.h"
+
+#define HIST_BUCKETS 25 /* 1 us to about 16.8 s */
+
+typedef struct mclient{
+    int fd;
+    int answered; /* 1 once the reply is rendered */
+    Reply out;
+    size_t sent;
+} MClient;
+
+static int listen_fd = -1;
+static char sock_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static MClient clients[METRICS_MAX_CLIENTS];
+static int num_clients = 0;
+static int timer_fd = -1;
+static char text_path[4096];
+static char tmp_path[4096 + 8];
+
+int metrics_open(const char *path){
+    struct sockaddr_un addr = {0};
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) return -1;
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listen_fd, SOMAXCONN) == -1){
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    strcpy(sock_path, path);
+    return 0;
+}
+
+int metrics_textfile(const char *path, int secs){
+    struct itimerspec its = {{secs, 0}, {secs, 0}};
+    if (secs < 1 || strlen(path) >= sizeof(text_path)) return -1;
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd == -1) return -1;
+    if (timerfd_settime(timer_fd, 0, &its, NULL) == -1){
+        close(timer_fd);
+        timer_fd = -1;
+        return -1;
+    }
+    strcpy(text_path, path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    return 0;
+}
+
+static void drop(MClient *c){
+    close(c->fd);
+    free(c->out.data);
+    *c = clients[--num_clients];
+    memset(&clients[num_clients], 0, sizeof(MClient));
+}
+
+void metrics_close(){
+    if (listen_fd == -1) return;
+    while (num_clients > 0) drop(&clients[0]);
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(sock_path);
+}
+
+int metrics_fds(struct pollfd *fds, int max){
+    int n = 0;
+    int i = 0;
+    if (timer_fd != -1 && n < max) fds[n++] = (struct pollfd){timer_fd, POLLIN, 0};
+    if (listen_fd == -1) return n;
+    if (num_clients < METRICS_MAX_CLIENTS && n < max){
+        fds[n++] = (struct pollfd){listen_fd, POLLIN, 0};
+    }
+    for (i=0;i<num_clients && n < max;i++){
+        fds[n++] = (struct pollfd){clients[i].fd, clients[i].answered ? POLLOUT : POLLIN, 0};
+    }
+    return n;
+}
+
+/* Writes the textfile through a temporary file and a rename */
+static void write_textfile(metrics_render render){
+    Reply body = {0};
+    uint64_t ticks = 0;
+    int fd = -1;
+    size_t done = 0;
+    ssize_t n = 0;
+    if (read(timer_fd, &ticks, sizeof(ticks)) != sizeof(ticks)) return;
+    render(&body);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1){
+        free(body.data);
+        return;
+    }
+    while (done < body.len){
+        n = write(fd, body.data + done, body.len - done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    if (close(fd) == 0 && done == body.len) rename(tmp_path, text_path);
+    else unlink(tmp_path);
+    free(body.data);
+}
+
+/* Reads the request and renders the reply. An HTTP GET gets a status line
+ * and headers first. Returns -1 if the client is gone. */
+static int answer(MClient *c, metrics_render render){
+    char req[4096];
+    Reply body = {0};
+    ssize_t n = read(c->fd, req, sizeof(req));
+    if (n == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (n <= 0) return -1;
+    render(&body);
+    if (n >= 4 && memcmp(req, "GET ", 4) == 0){
+        reply_add(&c->out, "HTTP/1.0 200 OK\r");
+        reply_add(&c->out, "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r");
+        reply_add(&c->out, "Content-Length: %zu\r", body.len);
+        reply_add(&c->out, "Connection: close\r");
+        reply_add(&c->out, "\r");
+    }
+    reply_add(&c->out, "%.*s", (int)body.len - 1, body.data);
+    free(body.data);
+    c->answered = 1;
+    return 0;
+}
+
+/* Sends what it can. Returns -1 once the client is done or gone. */
+static int flush(MClient *c){
+    ssize_t n = 0;
+    while (c->sent < c->out.len){
+        n = send(c->fd, c->out.data + c->sent, c->out.len - c->sent, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n == -1) return -1;
+        c->sent += n;
+    }
+    return -1;
+}
+
+void metrics_service(struct pollfd *fds, int n, metrics_render render){
+    int i = 0;
+    int k = 0;
+    int fd = -1;
+    int gone = 0;
+    MClient *c = NULL;
+    for (i=0;i<n;i++){
+        if (fds[i].revents == 0) continue;
+        if (fds[i].fd == timer_fd){
+            write_textfile(render);
+            continue;
+        }
+        if (fds[i].fd == listen_fd){
+            while (num_clients < METRICS_MAX_CLIENTS){
+                fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd == -1) break;
+                clients[num_clients++].fd = fd;
+            }
+            continue;
+        }
+        c = NULL;
+        for (k=0;k<num_clients;k++){
+            if (clients[k].fd == fds[i].fd) c = &clients[k];
+        }
+        if (c == NULL) continue;
+        if (!c->answered && (fds[i].revents & POLLIN)) gone = answer(c, render);
+        else if (c->answered && (fds[i].revents & POLLOUT)) gone = 0;
+        else gone = -1;
+        if (gone == 0 && c->answered) gone = flush(c);
+        if (gone == -1) drop(c);
+    }
+}
+
+/* Prints a value the way OpenMetrics expects, integers without a fraction */
+static void format_value(char *buf, size_t size, double value){
+    if (value == floor(value) && fabs(value) < 1e15) snprintf(buf, size, "%.0f", value);
+    else snprintf(buf, size, "%.9g", value);
+}
+
+void metrics_family(Reply *out, const char *name, const char *type, const char *unit, const char *help){
+    reply_add(out, "# TYPE %s %s", name, type);
+    if (unit != NULL) reply_add(out, "# UNIT %s %s", name, unit);
+    reply_add(out, "# HELP %s %s", name, help);
+}
+
+void metrics_sample(Reply *out, const char *name, const char *labels, double value){
+    char v[32];
+    format_value(v, sizeof(v), value);
+    if (labels == NULL || *labels == '\0') reply_add(out, "%s %s", name, v);
+    else reply_add(out, "%s{%s} %s", name, labels, v);
+}
+
+void metrics_hist(Reply *out, const char *name, const char *labels, const Hist *h){
+    char le[64];
+    char v[32];
+    const char *sep = (labels == NULL || *labels == '\0') ? "" : ",";
+    int k = 0;
+    if (labels == NULL) labels = "";
+    for (k=0;k<HIST_BUCKETS;k++){
+        format_value(v, sizeof(v), (1LL << k) / 1e6);
+        snprintf(le, sizeof(le), "le=\"%s\"", v);
+        reply_add(out, "%s_bucket{%s%s%s} %lld", name, labels, sep, le,
+                  hist_count_range(h, 0, (1000LL << k) + 1));
+    }
+    reply_add(out, "%s_bucket{%s%sle=\"+Inf\"} %lld", name, labels, sep, h->count);
+    format_value(v, sizeof(v), h->sum / 1e9);
+    if (*labels == '\0'){
+        reply_add(out, "%s_count %lld", name, h->count);
+        reply_add(out, "%s_sum %s", name, v);
+    }
+    else{
+        reply_add(out, "%s_count{%s} %lld", name, labels, h->count);
+        reply_add(out, "%s_sum{%s} %s", name, labels, v);
+    }
+}
@@ -0,0 +1,312 @@
+/* Microbenchmark of the per-command parsing path.
+ * - Feeds a mix of realistic command lines (builtins, long argv, redirects)
+ *   through get_input(), parse() with builtin_parse(), string_copy() and
+ *   clone_argv(), and through the whole life of one typed line, and reports
+ *   ns, allocations and bytes allocated per command for each stage.
+ * - Allocations are counted by wrapping malloc, calloc, realloc and free at
+ *   link time (-Wl,--wrap), so only calls made by the shell's own code count,
+ *   not those inside libc.
+ * - get_input() reads from a file on an unbuffered stdin, as the shell sets
+ *   it up, so its read per byte is part of what is measured.
+ * - Each stage runs -r times over its share of the lines and keeps its
+ *   fastest run, which shrugs off most of a busy machine's noise.
+ * - With -c BASELINE the results are compared against a saved run and any
+ *   stage that allocates more fails the run. Counts are exact, but time
+ *   depends on the machine and its load, so it only fails a stage more
+ *   than -s PCT slower when -s is given. -w BASELINE saves a run.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../inc/anav.h"
+#include "../inc/parse.h"
+#include "../inc/builtins.h"
+#include "../inc/util.h"
+#include "../inc/clock.h"
+
+#define MAX_STAGES 8
+
+typedef struct line{
+    const char *text;
+    int adds; /* not a builtin: the shell keeps copies of the line and argv */
+} Line;
+
+typedef struct result{
+    const char *stage;
+    double ns;
+    double allocs;
+    double bytes;
+} Result;
+
+static const Line workload[] = {
+    {"my_echo hello world", 1},
+    {"bg 12", 0},
+    {"exec 3 <in.txt >out.txt", 0},
+    {"pipe 4 5", 0},
+    {"kill 17", 0},
+    {"after 9 3 4 ok >log.txt", 0},
+    {"tail 3 20", 0},
+    {"bench 2 100 warmup 5 par 4", 0},
+    {"cpu_burn 200 -t 4 -q -v -v -v -x a b c d e f g h i j k l m n o", 1},
+    {"latency on", 0},
+    {"pipe_source 64", 1},
+    {"resume 8", 0},
+    {"slow_cooker 5 3 --label dinner --verbose", 1},
+    {"list", 0},
+};
+#define NUM_LINES (int)(sizeof(workload) / sizeof(workload[0]))
+
+long long allocs = 0;
+long long frees = 0;
+long long alloc_bytes = 0;
+Result results[MAX_STAGES];
+int num_results = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void __real_free(void *p);
+
+void *__wrap_malloc(size_t size){
+    allocs++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size){
+    allocs++;
+    alloc_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size){
+    allocs++;
+    alloc_bytes += size;
+    return __real_realloc(p, size);
+}
+
+void __wrap_free(void *p){
+    if (p != NULL) frees++;
+    __real_free(p);
+}
+
+void stage_start(long long *t){
+    allocs = frees = alloc_bytes = 0;
+    *t = now_ns();
+}
+
+/* Records a run of a stage, keeping the fastest of its repeats */
+void stage_end(const char *stage, long long t, int n){
+    double ns = (now_ns() - t) / (double)n;
+    Result *r = NULL;
+    for (int i = 0; i < num_results; i++){
+        if (strcmp(results[i].stage, stage) == 0) r = &results[i];
+    }
+    if (r == NULL){
+        r = &results[num_results++];
+        r->ns = ns;
+    }
+    if (ns < r->ns) r->ns = ns;
+    r->stage = stage;
+    r->allocs = allocs / (double)n;
+    r->bytes = alloc_bytes / (double)n;
+    if (allocs != frees) fprintf(stderr, "parse_bench: %s leaked %lld allocation(s)\n", stage, allocs - frees);
+}
+
+/* Writes the n workload lines of a stage twice, once for each stage that
+ * reads, to a temporary file and makes it the unbuffered stdin get_input()
+ * reads */
+void feed_stdin(int n){
+    char path[] = "/tmp/parse_bench.XXXXXX";
+    FILE *f = NULL;
+    int fd = mkstemp(path);
+    if (fd == -1 || (f = fdopen(fd, "w")) == NULL){
+        perror("parse_bench");
+        exit(1);
+    }
+    unlink(path);
+    for (int i = 0; i < 2 * n; i++) fprintf(f, "%s\n", workload[(i % n) % NUM_LINES].text);
+    fflush(f);
+    lseek(fd, 0, SEEK_SET);
+    dup2(fd, STDIN_FILENO);
+    setvbuf(stdin, NULL, _IONBF, 0);
+}
+
+void bench_get_input(int n){
+    long long t = 0;
+    stage_start(&t);
+    for (int i = 0; i < n; i++) free(get_input());
+    stage_end("get_input", t, n);
+}
+
+void bench_parse(int n){
+    char *argv[MAXARGS+1];
+    Instruction inst;
+    long long t = 0;
+    stage_start(&t);
+    for (int i = 0; i < n; i++){
+        initialize_command(&inst, argv);
+        parse(workload[i % NUM_LINES].text, &inst, argv);
+        builtin_parse(&inst, argv);
+        free_command(NULL, &inst, argv);
+    }
+    stage_end("parse", t, n);
+}
+
+void bench_string_copy(int n){
+    long long t = 0;
+    stage_start(&t);
+    for (int i = 0; i < n; i++) free(string_copy(workload[i % NUM_LINES].text));
+    stage_end("string_copy", t, n);
+}
+
+/* Copies the argv of each command line, as a new task does */
+void bench_clone_argv(int n){
+    char *argv[NUM_LINES][MAXARGS+1];
+    Instruction inst;
+    int k = 0;
+    long long t = 0;
+    for (int i = 0; i < NUM_LINES; i++){
+        initialize_command(&inst, argv[k]);
+        parse(workload[i].text, &inst, argv[k]);
+        builtin_parse(&inst, argv[k]);
+        free_instruction(&inst);
+        if (workload[i].adds) k++;
+        else free_argv_str(argv[k]);
+    }
+    stage_start(&t);
+    for (int i = 0; i < n; i++) free_argv(clone_argv(argv[i % k]));
+    stage_end("clone_argv", t, n);
+    for (int i = 0; i < k; i++) free_argv_str(argv[i]);
+}
+
+/* The life of one typed line, less the command itself: read, parse, the
+ * copies a new task keeps, and the frees */
+void bench_command(int n){
+    char *argv[MAXARGS+1];
+    Instruction inst;
+    char *cmd = NULL;
+    char *kept_cmd = NULL;
+    char **kept_argv = NULL;
+    long long t = 0;
+    stage_start(&t);
+    for (int i = 0; i < n; i++){
+        cmd = get_input();
+        initialize_command(&inst, argv);
+        parse(cmd, &inst, argv);
+        builtin_parse(&inst, argv);
+        if (workload[i % NUM_LINES].adds){
+            kept_cmd = string_copy(cmd);
+            kept_argv = clone_argv(argv);
+            free(kept_cmd);
+            free_argv(kept_argv);
+        }
+        free_command(cmd, &inst, argv);
+    }
+    stage_end("command", t, n);
+}
+
+void print_results(){
+    printf("%-14s %10s %12s %12s\n", "stage", "ns/cmd", "allocs/cmd", "bytes/cmd");
+    for (int i = 0; i < num_results; i++){
+        printf("%-14s %10.1f %12.2f %12.1f\n", results[i].stage, results[i].ns, results[i].allocs, results[i].bytes);
+    }
+}
+
+void save_baseline(const char *path){
+    FILE *f = fopen(path, "w");
+    if (f == NULL){
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "# stage ns_per_cmd allocs_per_cmd bytes_per_cmd\n");
+    for (int i = 0; i < num_results; i++){
+        fprintf(f, "%s %.1f %.2f %.1f\n", results[i].stage, results[i].ns, results[i].allocs, results[i].bytes);
+    }
+    fclose(f);
+}
+
+/* Compares against a saved run, and time too unless slack is negative.
+ * Returns the number of stages that regressed. */
+int compare_baseline(const char *path, double slack){
+    char line[256];
+    char stage[64];
+    double ns = 0;
+    double a = 0;
+    double b = 0;
+    int regressed = 0;
+    FILE *f = fopen(path, "r");
+    if (f == NULL){
+        perror(path);
+        exit(1);
+    }
+    printf("\n%-14s %10s %12s %12s\n", "vs baseline", "ns", "allocs", "bytes");
+    while (fgets(line, sizeof(line), f) != NULL){
+        if (line[0] == '#' || sscanf(line, "%63s %lf %lf %lf", stage, &ns, &a, &b) != 4) continue;
+        for (int i = 0; i < num_results; i++){
+            Result *r = &results[i];
+            if (strcmp(r->stage, stage) != 0) continue;
+            /* Counts are exact, time is allowed some noise */
+            int worse = r->allocs > a + 0.005 || r->bytes > b + 0.05 || (slack >= 0 && r->ns > ns * (1 + slack/100));
+            printf("%-14s %+9.1f%% %+12.2f %+12.1f%s\n", stage, (r->ns - ns) * 100 / ns,
+                   r->allocs - a, r->bytes - b, worse ? "   REGRESSION" : "");
+            regressed += worse;
+        }
+    }
+    fclose(f);
+    return regressed;
+}
+
+int main(int argc, char *argv[]){
+    int n = 1000000;
+    int repeats = 5;
+    double slack = -1;
+    char *compare = NULL;
+    char *save = NULL;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "c:n:r:s:w:")) != -1){
+        switch (opt){
+            case 'c':
+                compare = optarg;
+                break;
+            case 'n':
+                n = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 's':
+                slack = atof(optarg);
+                break;
+            case 'w':
+                save = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n LINES] [-r REPEATS] [-c BASELINE [-s PCT]] [-w BASELINE]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (repeats < 1 || n / repeats < NUM_LINES){
+        fprintf(stderr, "parse_bench: need at least %d lines per repeat\n", NUM_LINES);
+        exit(1);
+    }
+
+    /* Every repeat reads a whole number of workload rounds, so the mix is
+     * the same in each */
+    n = n / repeats / NUM_LINES * NUM_LINES;
+    feed_stdin(n * repeats);
+    printf("parse_bench: %d command lines per stage, fastest of %d, %d distinct\n", n, repeats, NUM_LINES);
+    for (int i = 0; i < repeats; i++) bench_get_input(n);
+    for (int i = 0; i < repeats; i++) bench_parse(n);
+    for (int i = 0; i < repeats; i++) bench_string_copy(n);
+    for (int i = 0; i < repeats; i++) bench_clone_argv(n);
+    for (int i = 0; i < repeats; i++) bench_command(n);
+    print_results();
+
+    if (save != NULL) save_baseline(save);
+    if (compare != NULL && compare_baseline(compare, slack) > 0) return 1;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include "../inc/pidmap.h"
+#include "../inc/memstat.h"
+
+typedef struct slot{
+    int pid; /* 0 for an empty slot */
+    void *v;
+} Slot;
+
+static Slot *slots = NULL;
+static unsigned size = 0; /* power of two */
+static unsigned used = 0;
+
+static unsigned home(int pid){
+    return ((unsigned)pid * 2654435761u) & (size - 1);
+}
+
+static void grow(){
+    Slot *old = slots;
+    unsigned old_size = size;
+    unsigned i = 0;
+    size = size ? size*2 : 1024;
+    slots = calloc(size, sizeof(Slot));
+    if (slots == NULL) exit(1);
+    mem_resize(MEM_INDEX, old_size*sizeof(Slot), size*sizeof(Slot));
+    used = 0;
+    for (i=0;i<old_size;i++){
+        if (old[i].pid != 0) pidmap_put(old[i].pid, old[i].v);
+    }
+    free(old);
+}
+
+void pidmap_put(int pid, void *v){
+    unsigned i = 0;
+    if ((used + 1) * 2 > size) grow();
+    for (i=home(pid); slots[i].pid != 0 && slots[i].pid != pid; i=(i+1) & (size-1));
+    if (slots[i].pid == 0) used++;
+    slots[i].pid = pid;
+    slots[i].v = v;
+}
+
+void *pidmap_get(int pid){
+    unsigned i = 0;
+    if (size == 0) return NULL;
+    for (i=home(pid); slots[i].pid != 0; i=(i+1) & (size-1)){
+        if (slots[i].pid == pid) return slots[i].v;
+    }
+    return NULL;
+}
+
+void pidmap_del(int pid){
+    unsigned i = 0;
+    unsigned j = 0;
+    unsigned h = 0;
+    if (size == 0) return;
+    for (i=home(pid); slots[i].pid != pid; i=(i+1) & (size-1)){
+        if (slots[i].pid == 0) return;
+    }
+    /* Move back each later entry of the run that may sit in the hole */
+    for (j=(i+1) & (size-1); slots[j].pid != 0; j=(j+1) & (size-1)){
+        h = home(slots[j].pid);
+        if (((j - h) & (size-1)) >= ((j - i) & (size-1))){
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].pid = 0;
+    slots[i].v = NULL;
+    used--;
+}
@@ -0,0 +1,39 @@
+/* A workload program provided as local executable.
+ * - Reads stdin until end of file, as the consumer half of a pipe
+ *   throughput test.
+ * - Prints the bytes received and the bandwidth between its first and
+ *   last read.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define CHUNK 65536
+
+long long now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(){
+    static char buf[CHUNK];
+    long long total = 0;
+    long long start = 0;
+    double secs = 0;
+    ssize_t n = 0;
+
+    while (1){
+        n = read(STDIN_FILENO, buf, CHUNK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (total == 0) start = now_ns();
+        total += n;
+    }
+    secs = total ? (now_ns() - start) / 1e9 : 0;
+    printf("pipe_sink: %lld bytes in %.3f s (%.1f MiB/s)\n", total, secs, secs > 0 ? total / secs / (1 << 20) : 0.0);
+    return 0;
+}
@@ -0,0 +1,31 @@
+/* A workload program provided as local executable.
+ * - Writes the given number of MiB (default 256) to stdout in 64KiB chunks,
+ *   as the producer half of a pipe throughput test.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define CHUNK 65536
+
+int main(int argc, char *argv[]){
+    static char buf[CHUNK];
+    long long total = 256LL << 20;
+    long long sent = 0;
+    ssize_t n = 0;
+
+    if (argc > 1) total = strtoll(argv[1], NULL, 10) << 20;
+    memset(buf, 'x', CHUNK);
+    while (sent < total){
+        n = write(STDOUT_FILENO, buf, total - sent < CHUNK ? total - sent : CHUNK);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        sent += n;
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+/* Runtime models, see predict.h.
+ * - Models live in an array indexed by an open-addressing hash table of
+ *   FNV-1a hashes, so a lookup on every start and exit costs a hash of
+ *   the key and a probe or two however many commands have been seen.
+ * - The variance follows West's weighted update, which needs no history:
+ *   var = (1 - a) * (var + a * (x - mean)^2) with the mean moved after.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include "../inc/predict.h"
+#include "../inc/util.h"
+
+#define KEY_MAX 1024
+
+typedef struct model{
+    char *key;
+    uint64_t hash;
+    long long runs;
+    double mean; /* ns */
+    double var;
+} Model;
+
+static Model *models = NULL;
+static int num_models = 0;
+static int models_size = 0;
+static int *slots = NULL; /* index into models, -1 where free */
+static int num_slots = 0;
+static char file_path[4096];
+static char tmp_path[4096 + 8];
+
+static uint64_t fnv(const char *s){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (;*s!='\0';s++){
+        h ^= (unsigned char)*s;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* Fills key with the command's key, or its executable's with whole set to
+ * 0. Arguments past the key's size are dropped. */
+static void make_key(char *argv[], int whole, char *key){
+    const char *base = strrchr(argv[0], '/');
+    int len = 0;
+    int i = 0;
+    len = snprintf(key, KEY_MAX, "%s", base != NULL ? base + 1 : argv[0]);
+    if (!whole){
+        snprintf(key + len, KEY_MAX - len, " *");
+        return;
+    }
+    for (i=1;argv[i] != NULL && len < KEY_MAX;i++){
+        len += snprintf(key + len, KEY_MAX - len, " %s", argv[i]);
+    }
+}
+
+/* Returns the slot of key, free if it has no model */
+static int *find(const char *key, uint64_t hash){
+    int i = hash & (num_slots - 1);
+    while (slots[i] != -1 && (models[slots[i]].hash != hash || strcmp(models[slots[i]].key, key) != 0)){
+        i = (i + 1) & (num_slots - 1);
+    }
+    return &slots[i];
+}
+
+/* Doubles the table and puts every model back in it */
+static void grow(){
+    int i = 0;
+    free(slots);
+    num_slots = num_slots ? num_slots*2 : 256;
+    slots = malloc(num_slots*sizeof(int));
+    if (slots == NULL) exit(1);
+    memset(slots, -1, num_slots*sizeof(int));
+    for (i=0;i<num_models;i++) *find(models[i].key, models[i].hash) = i;
+}
+
+static Model *get(const char *key, int create){
+    uint64_t hash = fnv(key);
+    int *slot = NULL;
+    if (num_slots == 0) grow();
+    slot = find(key, hash);
+    if (*slot != -1) return &models[*slot];
+    if (!create) return NULL;
+    if (num_models == models_size){
+        models_size = models_size ? models_size*2 : 64;
+        models = realloc(models, models_size*sizeof(Model));
+        if (models == NULL) exit(1);
+    }
+    models[num_models] = (Model){string_copy(key), hash, 0, 0, 0};
+    *slot = num_models++;
+    /* Kept at most half full, so probes stay short */
+    if (num_models*2 > num_slots) grow();
+    return &models[num_models-1];
+}
+
+int predict_open(const char *path){
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len = 0;
+    long long runs = 0;
+    double mean = 0;
+    double sd = 0;
+    int n = 0;
+    Model *m = NULL;
+    FILE *f = NULL;
+    if (path == NULL) return 0;
+    if (strlen(path) >= sizeof(file_path)) return -1;
+    strcpy(file_path, path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    f = fopen(path, "re");
+    /* A model file not written yet starts empty */
+    if (f == NULL) return errno == ENOENT ? 0 : -1;
+    while ((len = getline(&line, &line_size, f)) != -1){
+        if (len > 0 && line[len-1] == '\n') line[--len] = '\0';
+        if (sscanf(line, "%lld %lf %lf %n", &runs, &mean, &sd, &n) != 3 || line[n] == '\0' || runs < 1) continue;
+        m = get(line + n, 1);
+        m->runs = runs;
+        m->mean = mean;
+        m->var = sd * sd;
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+void predict_save(){
+    FILE *f = NULL;
+    int ok = 1;
+    int i = 0;
+    if (file_path[0] == '\0') return;
+    f = fopen(tmp_path, "we");
+    if (f == NULL) return;
+    for (i=0;i<num_models && ok;i++){
+        ok = fprintf(f, "%lld %.0f %.0f %s\n", models[i].runs, models[i].mean, sqrt(models[i].var), models[i].key) > 0;
+    }
+    if (fclose(f) == 0 && ok) rename(tmp_path, file_path);
+    else remove(tmp_path);
+}
+
+int predict_get(char *argv[], long long *mean_ns, long long *sd_ns){
+    char key[KEY_MAX];
+    Model *m = NULL;
+    make_key(argv, 1, key);
+    m = get(key, 0);
+    if (m == NULL){
+        make_key(argv, 0, key);
+        m = get(key, 0);
+    }
+    if (m == NULL) return -1;
+    *mean_ns = m->mean;
+    *sd_ns = sqrt(m->var);
+    return 0;
+}
+
+/* Moves a model toward a new run */
+static void update(Model *m, double x){
+    double d = x - m->mean;
+    if (m->runs++ == 0){
+        m->mean = x;
+        m->var = 0;
+        return;
+    }
+    m->var = (1 - PREDICT_ALPHA) * (m->var + PREDICT_ALPHA * d * d);
+    m->mean += PREDICT_ALPHA * d;
+}
+
+void predict_record(char *argv[], long long ns){
+    char key[KEY_MAX];
+    make_key(argv, 1, key);
+    update(get(key, 1), ns);
+    make_key(argv, 0, key);
+    update(get(key, 1), ns);
+}
+
+int predict_count(){
+    return num_models;
+}
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../inc/ring.h"
+#include "../inc/memstat.h"
+
+void ring_init(Ring *r, size_t cap){
+    memset(r, 0, sizeof(Ring));
+    r->cap = cap;
+}
+
+void ring_free(Ring *r){
+    mem_sub(MEM_OUTPUT, r->size);
+    free(r->data);
+    ring_init(r, r->cap);
+}
+
+/* Grows the buffer to hold need bytes, up to the cap. The ring only wraps
+ * once it is full size, so until then the bytes start at offset 0. */
+static void grow(Ring *r, size_t need){
+    size_t size = r->size ? r->size : 4096;
+    while (size < need) size *= 2;
+    if (size > r->cap) size = r->cap;
+    if (size <= r->size) return;
+    r->data = realloc(r->data, size);
+    if (r->data == NULL) exit(1);
+    mem_resize(MEM_OUTPUT, r->size, size);
+    r->size = size;
+}
+
+void ring_write(Ring *r, const char *buf, size_t n){
+    size_t pos = 0;
+    size_t first = 0;
+    if (r->cap == 0) return;
+    r->total += n;
+    if (n >= r->cap){
+        buf += n - r->cap;
+        n = r->cap;
+        r->start = 0;
+        r->len = 0;
+    }
+    if (r->len + n > r->size) grow(r, r->len + n);
+    pos = (r->start + r->len) % r->size;
+    first = r->size - pos < n ? r->size - pos : n;
+    memcpy(r->data + pos, buf, first);
+    memcpy(r->data, buf + first, n - first);
+    r->len += n;
+    if (r->len > r->size){
+        r->start = (r->start + r->len - r->size) % r->size;
+        r->len = r->size;
+    }
+}
+
+char *ring_tail(const Ring *r, int lines, size_t *n){
+    size_t i = 0;
+    size_t from = 0;
+    size_t k = 0;
+    char *out = NULL;
+    /* Walk back from the end, not counting a final newline */
+    for (i=r->len;i>0;i--){
+        if (r->data[(r->start + i - 1) % r->size] == '\n' && i != r->len && --lines == 0) break;
+    }
+    from = i;
+    out = malloc(r->len - from + 1);
+    if (out == NULL) exit(1);
+    for (k=from;k<r->len;k++) out[k-from] = r->data[(r->start + k) % r->size];
+    *n = r->len - from;
+    return out;
+}
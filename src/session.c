@@ -0,0 +1,162 @@
+/* Session recording and replay, see session.h.
+ * - The recording goes through stdio's buffer and is flushed on every
+ *   command, so a busy session costs a formatted line per event and no
+ *   write per exit.
+ * - A replayed task is matched to its recording by task number, which
+ *   holds as long as the replay starts from the same empty table.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../inc/session.h"
+#include "../inc/util.h"
+#include "../inc/clock.h"
+
+typedef struct command{
+    long long ns;
+    int from_socket;
+    char *cmd;
+} Command;
+
+static FILE *rec = NULL;
+static long long origin = 0;
+static SessionStats live = {.first_ns = -1};
+static SessionStats recorded = {.first_ns = -1};
+static Command *commands = NULL;
+static int next_command = 0;
+static int *codes = NULL; /* recorded exit code by task number, -1 if none */
+static int codes_size = 0;
+
+static void stats_reset(SessionStats *s){
+    memset(s, 0, sizeof(SessionStats));
+    s->first_ns = -1;
+    hist_reset(&s->spawn);
+    hist_reset(&s->reap);
+    hist_reset(&s->run);
+}
+
+static void add_command(SessionStats *s, long long ns){
+    if (s->first_ns == -1) s->first_ns = ns;
+    s->commands++;
+}
+
+static void add_exit(SessionStats *s, long long ns, long long run_ns, long long reap_ns){
+    s->exits++;
+    s->last_ns = ns;
+    hist_record(&s->run, run_ns);
+    hist_record(&s->reap, reap_ns);
+}
+
+void session_start(long long origin_ns){
+    origin = origin_ns;
+    stats_reset(&live);
+}
+
+int session_record(const char *path){
+    rec = fopen(path, "we");
+    if (rec == NULL) return -1;
+    fprintf(rec, "# anav session v1\n");
+    return 0;
+}
+
+void session_close(){
+    if (rec != NULL) fclose(rec);
+    rec = NULL;
+}
+
+void session_command(const char *cmd, int from_socket){
+    long long ns = now_ns() - origin;
+    add_command(&live, ns);
+    if (rec == NULL) return;
+    fprintf(rec, "%c %lld %s\n", from_socket ? 'k' : 'c', ns / 1000, cmd);
+    fflush(rec);
+}
+
+void session_started(int task_num, long long spawn_ns){
+    live.starts++;
+    hist_record(&live.spawn, spawn_ns);
+    if (rec != NULL) fprintf(rec, "s %lld %d %lld\n", (now_ns() - origin) / 1000, task_num, spawn_ns / 1000);
+}
+
+void session_exited(int task_num, long long run_ns, int code, long long reap_ns){
+    long long ns = now_ns() - origin;
+    add_exit(&live, ns, run_ns, reap_ns);
+    if (task_num < codes_size && codes[task_num] != -1 && codes[task_num] != code) live.mismatches++;
+    if (rec != NULL) fprintf(rec, "x %lld %d %lld %d %lld\n", ns / 1000, task_num, run_ns / 1000, code, reap_ns / 1000);
+}
+
+/* Keeps the exit code task_num ended with in the recording */
+static void add_code(int task_num, int code){
+    int old_size = codes_size;
+    if (task_num < 0) return;
+    if (task_num >= codes_size){
+        while (codes_size <= task_num) codes_size = codes_size ? codes_size*2 : 64;
+        codes = realloc(codes, codes_size*sizeof(int));
+        if (codes == NULL) exit(1);
+        memset(codes + old_size, -1, (codes_size - old_size)*sizeof(int));
+    }
+    codes[task_num] = code;
+}
+
+int session_load(const char *path){
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len = 0;
+    long long us = 0;
+    long long a = 0;
+    long long b = 0;
+    int task_num = 0;
+    int code = 0;
+    int n = 0;
+    int count = 0;
+    int size = 0;
+    FILE *f = fopen(path, "re");
+    if (f == NULL) return -1;
+    stats_reset(&recorded);
+    while ((len = getline(&line, &line_size, f)) != -1){
+        if (len > 0 && line[len-1] == '\n') line[--len] = '\0';
+        if ((line[0] == 'c' || line[0] == 'k') && sscanf(line + 1, " %lld %n", &us, &n) == 1){
+            if (count == size){
+                size = size ? size*2 : 64;
+                commands = realloc(commands, (size + 1)*sizeof(Command));
+                if (commands == NULL) exit(1);
+            }
+            commands[count++] = (Command){us*1000, line[0] == 'k', string_copy(line + 1 + n)};
+            add_command(&recorded, us*1000);
+        }
+        else if (line[0] == 's' && sscanf(line + 1, "%lld %d %lld", &us, &task_num, &a) == 3){
+            recorded.starts++;
+            hist_record(&recorded.spawn, a*1000);
+        }
+        else if (line[0] == 'x' && sscanf(line + 1, "%lld %d %lld %d %lld", &us, &task_num, &a, &code, &b) == 5){
+            add_exit(&recorded, us*1000, a*1000, b*1000);
+            add_code(task_num, code);
+        }
+    }
+    free(line);
+    fclose(f);
+    if (commands == NULL) commands = calloc(1, sizeof(Command));
+    if (commands == NULL) exit(1);
+    commands[count].cmd = NULL;
+    next_command = 0;
+    return count;
+}
+
+const char *session_next(long long *ns, int *from_socket){
+    Command *c = NULL;
+    if (commands == NULL || commands[next_command].cmd == NULL) return NULL;
+    c = &commands[next_command++];
+    *ns = c->ns;
+    *from_socket = c->from_socket;
+    return c->cmd;
+}
+
+const SessionStats *session_recorded(){
+    return &recorded;
+}
+
+const SessionStats *session_replayed(){
+    return &live;
+}
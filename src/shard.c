@@ -0,0 +1,175 @@
+/* Sharded reaping, see shard.h.
+ * - A shard is picked by pid, so watching needs no lock: epoll_ctl on the
+ *   shard's epoll set is safe while the thread waits on it.
+ * - A thread takes its queue lock once per epoll_wait batch and pokes the
+ *   eventfd once per batch, not once per child.
+ * - Threads collect exits without reaping them, so a pid is not reused while
+ *   its exit still waits in a queue and cannot be matched to a newer child.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "../inc/shard.h"
+#include "../inc/clock.h"
+
+#define SHARD_BATCH 256
+
+typedef struct shard{
+    pthread_t thread;
+    int epfd;
+    pthread_mutex_t lock;
+    ShardEvent *queue; /* exits not drained yet */
+    int count;
+    int size;
+} Shard;
+
+static Shard shards[SHARD_MAX];
+static int num_shards = 0;
+static int event_fd = -1;
+
+int wstatus_of(const siginfo_t *info){
+    switch (info->si_code){
+        case CLD_EXITED:
+            return W_EXITCODE(info->si_status, 0);
+        case CLD_KILLED:
+        case CLD_DUMPED:
+            return W_EXITCODE(0, info->si_status);
+        case CLD_STOPPED:
+        case CLD_TRAPPED:
+            return W_STOPCODE(info->si_status);
+        default:
+            return 0xffff; /* continued, see WIFCONTINUED */
+    }
+}
+
+/* Reaps the exited children among ready and queues them */
+static void *supervise(void *arg){
+    Shard *s = arg;
+    struct epoll_event ready[SHARD_BATCH];
+    ShardEvent batch[SHARD_BATCH];
+    siginfo_t info;
+    uint64_t one = 1;
+    int fd = -1;
+    int n = 0;
+    int reaped = 0;
+    int k = 0;
+    int i = 0;
+    while (1){
+        n = epoll_wait(s->epfd, ready, SHARD_BATCH, -1);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) return NULL;
+        k = 0;
+        for (i=0;i<n;i++){
+            fd = ready[i].data.u64 >> 32;
+            memset(&info, 0, sizeof(info));
+            memset(&batch[k], 0, sizeof(ShardEvent));
+            /* The raw call, since glibc's waitid has no rusage argument.
+             * WNOWAIT leaves the zombie, and so its pid, in place until the
+             * shell has applied the exit; the shell releases it when it
+             * drains. A readable pidfd means the child has exited, so the
+             * watch is done with either way. */
+            reaped = syscall(SYS_waitid, P_PIDFD, fd, &info, WEXITED | WNOHANG | WNOWAIT, &batch[k].usage) == 0;
+            epoll_ctl(s->epfd, EPOLL_CTL_DEL, fd, NULL);
+            if (!reaped || info.si_pid == 0){
+                close(fd);
+                continue;
+            }
+            batch[k].pid = (int)(ready[i].data.u64 & 0xffffffff);
+            batch[k].pidfd = fd;
+            batch[k].wstatus = wstatus_of(&info);
+            batch[k].ns = now_ns();
+            k++;
+        }
+        if (k == 0) continue;
+        pthread_mutex_lock(&s->lock);
+        if (s->count + k > s->size){
+            while (s->count + k > s->size) s->size = s->size ? s->size*2 : 1024;
+            s->queue = realloc(s->queue, s->size * sizeof(ShardEvent));
+            if (s->queue == NULL) exit(1);
+        }
+        memcpy(s->queue + s->count, batch, k * sizeof(ShardEvent));
+        s->count += k;
+        pthread_mutex_unlock(&s->lock);
+        write(event_fd, &one, sizeof(one));
+    }
+}
+
+int shards_start(int n){
+    sigset_t all;
+    sigset_t old;
+    int i = 0;
+    if (n < 1 || n > SHARD_MAX) return -1;
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd == -1) return -1;
+    /* Threads start with every signal blocked, so the handler keeps running
+     * on the shell's thread only */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i=0;i<n;i++){
+        shards[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        pthread_mutex_init(&shards[i].lock, NULL);
+        if (shards[i].epfd == -1 || pthread_create(&shards[i].thread, NULL, supervise, &shards[i]) != 0){
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            return -1;
+        }
+        num_shards++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return 0;
+}
+
+void shard_watch(int pid, int pidfd){
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)pidfd << 32) | (uint32_t)pid;
+    epoll_ctl(shards[pid % num_shards].epfd, EPOLL_CTL_ADD, pidfd, &ev);
+}
+
+int shard_fd(){
+    return event_fd;
+}
+
+int shards_drain(shard_fn fn){
+    static ShardEvent *spare = NULL;
+    static int spare_size = 0;
+    ShardEvent *q = NULL;
+    siginfo_t info;
+    uint64_t ticks = 0;
+    int size = 0;
+    int count = 0;
+    int total = 0;
+    int i = 0;
+    int k = 0;
+    read(event_fd, &ticks, sizeof(ticks));
+    for (i=0;i<num_shards;i++){
+        /* Swap the queue for the spare one so the thread is never held up
+         * while the exits are applied */
+        pthread_mutex_lock(&shards[i].lock);
+        q = shards[i].queue;
+        size = shards[i].size;
+        count = shards[i].count;
+        shards[i].queue = spare;
+        shards[i].size = spare_size;
+        shards[i].count = 0;
+        pthread_mutex_unlock(&shards[i].lock);
+        for (k=0;k<count;k++){
+            fn(&q[k]);
+            /* Only now may the pid be handed to a new child */
+            waitid(P_PIDFD, q[k].pidfd, &info, WEXITED | WNOHANG);
+            close(q[k].pidfd);
+        }
+        total += count;
+        spare = q;
+        spare_size = size;
+    }
+    return total;
+}
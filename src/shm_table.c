@@ -0,0 +1,122 @@
+/* Shared-memory task table: see shm_table.h */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_table.h"
+
+static ShmHeader *table = NULL;
+static size_t table_size = 0;
+static char table_name[64] = "";
+
+static ShmEntry *slots(const ShmHeader *hdr) {
+    return (ShmEntry *)(hdr + 1);
+}
+
+int shm_table_open(const char *name, uint32_t capacity) {
+    int fd = -1;
+    size_t size = sizeof(ShmHeader) + (size_t)capacity * sizeof(ShmEntry);
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) { return -1; }
+    // tmpfs only backs the pages that get written, so a large capacity is cheap
+    if (ftruncate(fd, size) == -1) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+        table = NULL;
+        shm_unlink(name);
+        return -1;
+    }
+    table_size = size;
+    strncpy(table_name, name, sizeof(table_name) - 1);
+
+    table->capacity = capacity;
+    table->entry_size = sizeof(ShmEntry);
+    table->shell_pid = getpid();
+    table->version = SHM_TABLE_VERSION;
+    __atomic_store_n(&table->magic, SHM_TABLE_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Seqlock write: readers that overlap the copy see an odd or changed counter */
+static void write_slot(ShmEntry *slot, const ShmEntry *entry) {
+    uint32_t seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char *)slot + sizeof(slot->seq), (const char *)entry + sizeof(entry->seq),
+           sizeof(ShmEntry) - sizeof(slot->seq));
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&table->generation, 1, __ATOMIC_RELEASE);
+}
+
+void shm_table_publish(const ShmEntry *entry) {
+    if (!table || entry->task_num < 1) { return; }
+    if ((uint32_t)entry->task_num > table->capacity) {
+        table->dropped++;
+        return;
+    }
+    write_slot(&slots(table)[entry->task_num - 1], entry);
+    if ((uint32_t)entry->task_num > table->high_water) {
+        __atomic_store_n(&table->high_water, entry->task_num, __ATOMIC_RELEASE);
+    }
+}
+
+void shm_table_clear(int task_num) {
+    ShmEntry empty;
+    if (!table || task_num < 1 || (uint32_t)task_num > table->capacity) { return; }
+    memset(&empty, 0, sizeof(empty));
+    write_slot(&slots(table)[task_num - 1], &empty);
+}
+
+void shm_table_close() {
+    if (!table) { return; }
+    munmap(table, table_size);
+    shm_unlink(table_name);
+    table = NULL;
+}
+
+const ShmHeader *shm_table_map(const char *name) {
+    struct stat st;
+    const ShmHeader *hdr = NULL;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) { return NULL; }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(ShmHeader)) {
+        close(fd);
+        return NULL;
+    }
+    hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) { return NULL; }
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_TABLE_MAGIC
+        || hdr->version != SHM_TABLE_VERSION || hdr->entry_size != sizeof(ShmEntry)
+        || sizeof(ShmHeader) + (size_t)hdr->capacity * sizeof(ShmEntry) > (size_t)st.st_size) {
+        munmap((void *)hdr, st.st_size);
+        return NULL;
+    }
+    return hdr;
+}
+
+void shm_table_read(const ShmHeader *hdr, uint32_t slot, ShmEntry *out) {
+    const ShmEntry *e = &slots(hdr)[slot];
+    uint32_t before = 0;
+    uint32_t after = 0;
+    for (int tries = 0; tries < 100000; tries++) {
+        before = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        memcpy(out, e, sizeof(ShmEntry));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+        if (!(before & 1) && before == after) {
+            out->cmd[SHM_TABLE_CMD_LEN - 1] = '\0';
+            return;
+        }
+    }
+    memset(out, 0, sizeof(ShmEntry));
+}
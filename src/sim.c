@@ -0,0 +1,650 @@
+/* Discrete-event CPU scheduler simulator.
+ * - Replays a workload trace through a scheduling policy on one simulated CPU
+ *   and reports throughput, turnaround, waiting and response times.
+ * - Trace format: one burst per line, "ID ARRIVAL CPU IO PRIORITY", times in ms.
+ *   Consecutive lines with the same ID are the successive bursts of one job:
+ *   the job computes for CPU, then blocks for IO, then moves to its next burst.
+ *   ARRIVAL is read from a job's first line. Lines starting with '#' are skipped.
+ *   Running anav with -x FILE records a trace of a real session in this format.
+ * - Policies: fcfs, sjf, srtf, rr, mlfq, lottery, cfs, or all to compare them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#define EV_ARRIVE  0
+#define EV_IO_DONE 1
+#define EV_CPU     2
+
+#define MLFQ_LEVELS 3
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+
+typedef struct job{
+    int id;
+    int priority;
+    long long arrival;
+    int first;              /* index of the first burst in the burst pool */
+    int nbursts;
+    int burst;              /* current burst */
+    long long remaining;    /* CPU left in the current burst */
+    long long first_run;    /* -1 until first dispatched */
+    long long ready_since;
+    long long waiting;
+    long long finish;
+    long long key;          /* ready queue order, set by the policy */
+    long long seq;
+    int heap_idx;
+    int level;              /* mlfq */
+    long long epoch;        /* mlfq boost period the level belongs to */
+    long long vruntime;     /* cfs */
+    int weight;             /* cfs and lottery */
+} Job;
+
+typedef struct event{
+    long long time;
+    long long seq;
+    int type;
+    int gen;
+    Job *job;
+} Event;
+
+typedef struct policy{
+    const char *name;
+    void (*enqueue)(Job *j, long long now);
+    Job* (*pick)(long long now);
+    long long (*slice)(Job *j);          /* longest uninterrupted run, 0 for the whole burst */
+    void (*charge)(Job *j, long long ran, int expired);
+    int (*preempts)(Job *running, Job *ready);
+} Policy;
+
+/* Workload */
+Job *jobs = NULL;
+int num_jobs = 0;
+long long *cpu_pool = NULL;
+long long *io_pool = NULL;
+int num_bursts = 0;
+
+/* Event queue */
+Event *events = NULL;
+int num_events = 0;
+int cap_events = 0;
+long long event_seq = 0;
+
+/* Ready queue */
+Job **ready = NULL;
+int num_ready = 0;
+long long ready_seq = 0;
+
+/* Tunables */
+long long quantum = 10000;         /* rr, mlfq base and lottery quantum (us) */
+long long boost_period = 1000000;  /* mlfq priority boost (us) */
+long long sched_latency = 24000;   /* cfs */
+long long min_granularity = 3000;  /* cfs */
+long long min_vruntime = 0;        /* cfs */
+long long boost_epoch = 0;         /* mlfq */
+long long total_weight = 0;        /* lottery tickets / cfs weight in the ready queue */
+unsigned long long rng = 88172645463325252ULL;
+
+/* Weight of each nice level, as used by the Linux CFS scheduler */
+static const int nice_weights[40] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+    9548, 7620, 6100, 4904, 3906, 3121, 2501, 1991, 1586, 1277,
+    1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45, 36, 29, 23, 18, 15,
+};
+
+unsigned long long next_rand(){
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+int nice_weight(int priority){
+    if (priority < NICE_MIN) priority = NICE_MIN;
+    if (priority > NICE_MAX) priority = NICE_MAX;
+    return nice_weights[priority - NICE_MIN];
+}
+
+/*********
+ * Event Queue: binary min-heap on (time, seq)
+ *********/
+
+int event_before(Event *a, Event *b){
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+void push_event(long long time, int type, Job *j, int gen){
+    int i = 0;
+    Event e = {time, event_seq++, type, gen, j};
+    if (num_events == cap_events){
+        cap_events = cap_events ? cap_events*2 : 1024;
+        events = realloc(events, cap_events*sizeof(Event));
+        if (events == NULL) exit(1);
+    }
+    i = num_events++;
+    while (i > 0 && event_before(&e, &events[(i-1)/2])){
+        events[i] = events[(i-1)/2];
+        i = (i-1)/2;
+    }
+    events[i] = e;
+}
+
+Event pop_event(){
+    Event top = events[0];
+    Event last = events[--num_events];
+    int i = 0;
+    int c = 0;
+    while ((c = 2*i+1) < num_events){
+        if (c+1 < num_events && event_before(&events[c+1], &events[c])) c++;
+        if (!event_before(&events[c], &last)) break;
+        events[i] = events[c];
+        i = c;
+    }
+    events[i] = last;
+    return top;
+}
+
+/*********
+ * Ready Queue: binary min-heap on (key, seq) with positions kept in each job
+ *********/
+
+int job_before(Job *a, Job *b){
+    return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+void ready_set(int i, Job *j){
+    ready[i] = j;
+    j->heap_idx = i;
+}
+
+void ready_up(int i){
+    Job *j = ready[i];
+    while (i > 0 && job_before(j, ready[(i-1)/2])){
+        ready_set(i, ready[(i-1)/2]);
+        i = (i-1)/2;
+    }
+    ready_set(i, j);
+}
+
+void ready_down(int i){
+    Job *j = ready[i];
+    int c = 0;
+    while ((c = 2*i+1) < num_ready){
+        if (c+1 < num_ready && job_before(ready[c+1], ready[c])) c++;
+        if (!job_before(ready[c], j)) break;
+        ready_set(i, ready[c]);
+        i = c;
+    }
+    ready_set(i, j);
+}
+
+void ready_push(Job *j){
+    j->seq = ready_seq++;
+    ready[num_ready] = j;
+    ready_up(num_ready++);
+}
+
+Job* ready_remove(int i){
+    Job *j = ready[i];
+    Job *last = ready[--num_ready];
+    if (i < num_ready){
+        ready_set(i, last);
+        ready_down(i);
+        ready_up(last->heap_idx);
+    }
+    return j;
+}
+
+Job* ready_pop(long long now){
+    if (num_ready == 0) return NULL;
+    return ready_remove(0);
+}
+
+/*********
+ * Policies
+ *********/
+
+long long no_slice(Job *j){ return 0; }
+long long rr_slice(Job *j){ return quantum; }
+void no_charge(Job *j, long long ran, int expired){}
+int no_preempt(Job *running, Job *r){ return 0; }
+
+void fcfs_enqueue(Job *j, long long now){
+    j->key = 0;
+    ready_push(j);
+}
+
+void sjf_enqueue(Job *j, long long now){
+    j->key = j->remaining;
+    ready_push(j);
+}
+
+int srtf_preempts(Job *running, Job *r){
+    return r->remaining < running->remaining;
+}
+
+/* mlfq: a job that uses its whole slice drops a level; every boost period
+ * all jobs return to the top level */
+void mlfq_boost(long long now){
+    int i = 0;
+    long long epoch = now / boost_period;
+    if (epoch == boost_epoch) return;
+    boost_epoch = epoch;
+    for (i=0;i<num_ready;i++){
+        ready[i]->level = 0;
+        ready[i]->epoch = epoch;
+        ready[i]->key = 0;
+    }
+    for (i=num_ready/2-1;i>=0;i--) ready_down(i);
+}
+
+void mlfq_enqueue(Job *j, long long now){
+    long long epoch = now / boost_period;
+    if (j->epoch != epoch){
+        j->level = 0;
+        j->epoch = epoch;
+    }
+    /* Jobs on the same level keep FIFO order through their sequence numbers */
+    j->key = j->level;
+    ready_push(j);
+}
+
+Job* mlfq_pick(long long now){
+    mlfq_boost(now);
+    return ready_pop(now);
+}
+
+long long mlfq_slice(Job *j){
+    return quantum << j->level;
+}
+
+void mlfq_charge(Job *j, long long ran, int expired){
+    if (expired && j->level < MLFQ_LEVELS-1) j->level++;
+}
+
+int mlfq_preempts(Job *running, Job *r){
+    return r->level < running->level;
+}
+
+/* lottery: tickets follow the nice weight of the job's priority */
+void lottery_enqueue(Job *j, long long now){
+    j->weight = nice_weight(j->priority);
+    total_weight += j->weight;
+    j->key = 0;
+    ready_push(j);
+}
+
+Job* lottery_pick(long long now){
+    long long draw = 0;
+    int i = 0;
+    if (num_ready == 0) return NULL;
+    draw = (long long)(next_rand() % (unsigned long long)total_weight);
+    for (i=0;i<num_ready-1;i++){
+        draw -= ready[i]->weight;
+        if (draw < 0) break;
+    }
+    total_weight -= ready[i]->weight;
+    return ready_remove(i);
+}
+
+/* cfs: run the job with the least weighted virtual runtime */
+void cfs_enqueue(Job *j, long long now){
+    j->weight = nice_weight(j->priority);
+    /* A waking job may not bank more than half a latency period of credit */
+    if (j->vruntime < min_vruntime - sched_latency/2) j->vruntime = min_vruntime - sched_latency/2;
+    total_weight += j->weight;
+    j->key = j->vruntime;
+    ready_push(j);
+}
+
+Job* cfs_pick(long long now){
+    Job *j = ready_pop(now);
+    if (j != NULL){
+        total_weight -= j->weight;
+        if (j->vruntime > min_vruntime) min_vruntime = j->vruntime;
+    }
+    return j;
+}
+
+long long cfs_slice(Job *j){
+    long long slice = 0;
+    if (total_weight == 0) return sched_latency;
+    slice = sched_latency * j->weight / (total_weight + j->weight);
+    return slice < min_granularity ? min_granularity : slice;
+}
+
+void cfs_charge(Job *j, long long ran, int expired){
+    j->vruntime += ran * 1024 / j->weight;
+}
+
+int cfs_preempts(Job *running, Job *r){
+    return r->vruntime + min_granularity < running->vruntime;
+}
+
+static const Policy policies[] = {
+    {"fcfs", fcfs_enqueue, ready_pop, no_slice, no_charge, no_preempt},
+    {"sjf", sjf_enqueue, ready_pop, no_slice, no_charge, no_preempt},
+    {"srtf", sjf_enqueue, ready_pop, no_slice, no_charge, srtf_preempts},
+    {"rr", fcfs_enqueue, ready_pop, rr_slice, no_charge, no_preempt},
+    {"mlfq", mlfq_enqueue, mlfq_pick, mlfq_slice, mlfq_charge, mlfq_preempts},
+    {"lottery", lottery_enqueue, lottery_pick, rr_slice, no_charge, no_preempt},
+    {"cfs", cfs_enqueue, cfs_pick, cfs_slice, cfs_charge, cfs_preempts},
+    {NULL, NULL, NULL, NULL, NULL, NULL},
+};
+
+/*********
+ * Workload Loading and Generation
+ *********/
+
+void add_burst(int id, long long arrival, long long cpu, long long io, int priority){
+    static int cap_jobs = 0;
+    static int cap_bursts = 0;
+    Job *j = NULL;
+    if (num_jobs == 0 || jobs[num_jobs-1].id != id){
+        if (num_jobs == cap_jobs){
+            cap_jobs = cap_jobs ? cap_jobs*2 : 1024;
+            jobs = realloc(jobs, cap_jobs*sizeof(Job));
+            if (jobs == NULL) exit(1);
+        }
+        j = &jobs[num_jobs++];
+        memset(j, 0, sizeof(Job));
+        j->id = id;
+        j->arrival = arrival;
+        j->priority = priority;
+        j->first = num_bursts;
+    }
+    if (num_bursts == cap_bursts){
+        cap_bursts = cap_bursts ? cap_bursts*2 : 1024;
+        cpu_pool = realloc(cpu_pool, cap_bursts*sizeof(long long));
+        io_pool = realloc(io_pool, cap_bursts*sizeof(long long));
+        if (cpu_pool == NULL || io_pool == NULL) exit(1);
+    }
+    cpu_pool[num_bursts] = cpu < 1 ? 1 : cpu;
+    io_pool[num_bursts] = io < 0 ? 0 : io;
+    num_bursts++;
+    jobs[num_jobs-1].nbursts++;
+}
+
+int load_trace(const char *path){
+    char line[256] = "";
+    int id = 0;
+    int priority = 0;
+    double arrival = 0;
+    double cpu = 0;
+    double io = 0;
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    while (fgets(line, sizeof(line), f) != NULL){
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%d %lf %lf %lf %d", &id, &arrival, &cpu, &io, &priority) != 5) continue;
+        add_burst(id, (long long)(arrival*1000), (long long)(cpu*1000), (long long)(io*1000), priority);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Exponentially distributed value with the given mean */
+long long exp_rand(double mean){
+    double u = (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+    long long v = (long long)(-mean * log(1.0 - u));
+    return v < 1 ? 1 : v;
+}
+
+/* Synthesizes n jobs: Poisson arrivals, 1-5 bursts each, exponential bursts */
+void generate(int n, double interarrival_ms){
+    int i = 0;
+    int b = 0;
+    int bursts = 0;
+    long long t = 0;
+    for (i=0;i<n;i++){
+        t += exp_rand(interarrival_ms*1000);
+        bursts = 1 + (int)(next_rand() % 5);
+        for (b=0;b<bursts;b++){
+            add_burst(i+1, t, exp_rand(8000), b == bursts-1 ? 0 : exp_rand(20000), (int)(next_rand() % 11) - 5);
+        }
+    }
+}
+
+void write_trace(FILE *f){
+    int i = 0;
+    int b = 0;
+    Job *j = NULL;
+    fprintf(f, "# id arrival_ms cpu_ms io_ms priority\n");
+    for (i=0;i<num_jobs;i++){
+        j = &jobs[i];
+        for (b=j->first;b<j->first+j->nbursts;b++){
+            fprintf(f, "%d %.3f %.3f %.3f %d\n", j->id, j->arrival/1000.0, cpu_pool[b]/1000.0, io_pool[b]/1000.0, j->priority);
+        }
+    }
+}
+
+/*********
+ * Simulation
+ *********/
+
+typedef struct result{
+    long long makespan;
+    long long busy;
+    long long num_events;
+    double wall;
+} Result;
+
+void make_ready(const Policy *p, Job *j, long long now){
+    j->ready_since = now;
+    p->enqueue(j, now);
+}
+
+Result simulate(const Policy *p){
+    Result res = {0};
+    Job *running = NULL;
+    Job *j = NULL;
+    Event e;
+    long long now = 0;
+    long long run_start = 0;
+    long long ran = 0;
+    long long slice = 0;
+    long long start_time = 0;
+    int cpu_gen = 0;
+    int i = 0;
+    int b = 0;
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    num_events = 0;
+    num_ready = 0;
+    total_weight = 0;
+    min_vruntime = 0;
+    boost_epoch = 0;
+    ready = realloc(ready, (num_jobs+1)*sizeof(Job*));
+    if (ready == NULL) exit(1);
+    for (i=0;i<num_jobs;i++){
+        j = &jobs[i];
+        j->burst = 0;
+        j->remaining = cpu_pool[j->first];
+        j->first_run = -1;
+        j->waiting = 0;
+        j->level = 0;
+        j->epoch = 0;
+        j->vruntime = 0;
+        push_event(j->arrival, EV_ARRIVE, j, 0);
+    }
+    start_time = num_jobs ? jobs[0].arrival : 0;
+    for (i=1;i<num_jobs;i++){
+        if (jobs[i].arrival < start_time) start_time = jobs[i].arrival;
+    }
+
+    while (num_events > 0){
+        e = pop_event();
+        now = e.time;
+        res.num_events++;
+        if (e.type == EV_CPU){
+            if (e.gen != cpu_gen) continue;  /* preempted since it was scheduled */
+            j = running;
+            running = NULL;
+            ran = now - run_start;
+            res.busy += ran;
+            j->remaining -= ran;
+            if (j->remaining > 0){
+                p->charge(j, ran, 1);
+                make_ready(p, j, now);
+            }
+            else{
+                p->charge(j, ran, 0);
+                b = j->first + j->burst;
+                if (io_pool[b] > 0) push_event(now + io_pool[b], EV_IO_DONE, j, 0);
+                else push_event(now, EV_IO_DONE, j, 0);
+            }
+        }
+        else{
+            /* Arrival or I/O completion */
+            j = e.job;
+            if (e.type == EV_IO_DONE){
+                if (++j->burst == j->nbursts){
+                    j->finish = now;
+                    continue;
+                }
+                j->remaining = cpu_pool[j->first + j->burst];
+            }
+            make_ready(p, j, now);
+            if (running != NULL){
+                /* Bring the running job up to date before asking the policy */
+                ran = now - run_start;
+                res.busy += ran;
+                running->remaining -= ran;
+                p->charge(running, ran, 0);
+                run_start = now;
+                if (p->preempts(running, j)){
+                    cpu_gen++;
+                    make_ready(p, running, now);
+                    running = NULL;
+                }
+            }
+        }
+        if (running == NULL && num_ready > 0){
+            running = p->pick(now);
+            running->waiting += now - running->ready_since;
+            if (running->first_run < 0) running->first_run = now;
+            run_start = now;
+            slice = p->slice(running);
+            if (slice <= 0 || slice > running->remaining) slice = running->remaining;
+            push_event(now + slice, EV_CPU, running, ++cpu_gen);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    res.makespan = now - start_time;
+    res.wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return res;
+}
+
+/*********
+ * Reporting
+ *********/
+
+int cmp_ll(const void *a, const void *b){
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts v in place and prints mean, p50, p90, p99 and max in ms */
+void print_dist(const char *name, long long *v, int n){
+    double sum = 0;
+    int i = 0;
+    if (n == 0) return;
+    qsort(v, n, sizeof(long long), cmp_ll);
+    for (i=0;i<n;i++) sum += v[i];
+    printf("  %-11s mean %10.3f  p50 %10.3f  p90 %10.3f  p99 %10.3f  max %10.3f\n", name,
+           sum/n/1000.0, v[n/2]/1000.0, v[(int)(n*0.9)]/1000.0, v[(int)(n*0.99)]/1000.0, v[n-1]/1000.0);
+}
+
+void report(const Policy *p, Result *r){
+    long long *v = malloc((num_jobs+1)*sizeof(long long));
+    int i = 0;
+    if (v == NULL) exit(1);
+    printf("%s: %d jobs, makespan %.3f ms, throughput %.2f jobs/s, cpu %.1f%%, %.2fM events/s\n",
+           p->name, num_jobs, r->makespan/1000.0,
+           r->makespan ? num_jobs / (r->makespan/1e6) : 0.0,
+           r->makespan ? 100.0*r->busy/r->makespan : 0.0,
+           r->wall > 0 ? r->num_events / r->wall / 1e6 : 0.0);
+    for (i=0;i<num_jobs;i++) v[i] = jobs[i].finish - jobs[i].arrival;
+    print_dist("turnaround", v, num_jobs);
+    for (i=0;i<num_jobs;i++) v[i] = jobs[i].waiting;
+    print_dist("waiting", v, num_jobs);
+    for (i=0;i<num_jobs;i++) v[i] = jobs[i].first_run - jobs[i].arrival;
+    print_dist("response", v, num_jobs);
+    free(v);
+}
+
+void usage(const char *prog){
+    fprintf(stderr, "Usage: %s [-p POLICY|all] [-q QUANTUM_MS] [-b BOOST_MS] [-s SEED]\n", prog);
+    fprintf(stderr, "       %*s (TRACE | -g JOBS [-a INTERARRIVAL_MS]) [-w OUTFILE]\n", (int)strlen(prog), "");
+    fprintf(stderr, "Policies: fcfs, sjf, srtf, rr, mlfq, lottery, cfs\n");
+}
+
+int main(int argc, char *argv[]){
+    const char *policy = "all";
+    const char *out = NULL;
+    double interarrival = 30;
+    int gen = 0;
+    int opt = 0;
+    int i = 0;
+    int found = 0;
+    Result r;
+    FILE *f = NULL;
+
+    while ((opt = getopt(argc, argv, "p:q:b:s:g:a:w:h")) != -1){
+        switch (opt){
+            case 'p': policy = optarg; break;
+            case 'q': quantum = (long long)(atof(optarg)*1000); break;
+            case 'b': boost_period = (long long)(atof(optarg)*1000); break;
+            case 's': rng = strtoull(optarg, NULL, 10) | 1; break;
+            case 'g': gen = atoi(optarg); break;
+            case 'a': interarrival = atof(optarg); break;
+            case 'w': out = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (quantum < 1 || boost_period < 1){
+        usage(argv[0]);
+        return 1;
+    }
+    if (gen > 0){
+        generate(gen, interarrival);
+    }
+    else if (optind < argc){
+        if (load_trace(argv[optind]) == -1){
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+    else{
+        usage(argv[0]);
+        return 1;
+    }
+    if (out != NULL){
+        f = fopen(out, "w");
+        if (f == NULL){
+            perror(out);
+            return 1;
+        }
+        write_trace(f);
+        fclose(f);
+    }
+    for (i=0;policies[i].name != NULL;i++){
+        if (strcmp(policy, "all") != 0 && strcmp(policy, policies[i].name) != 0) continue;
+        found = 1;
+        r = simulate(&policies[i]);
+        report(&policies[i], &r);
+    }
+    if (!found){
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
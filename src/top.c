@@ -0,0 +1,163 @@
+/* Process sampling and line-diffed redraws for the top view, see top.h.
+ * - /proc files give a fresh snapshot on every read from offset 0, so an
+ *   open descriptor can be re-read with pread for as long as the process
+ *   lives; once it is reaped the reads fail and the sampler is closed.
+ * - Frames are built into one buffer of cursor moves and line text and
+ *   written with a single write, so the terminal never shows half a frame.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../inc/top.h"
+#include "../inc/memstat.h"
+
+static char *lines = NULL; /* what each terminal line shows, rows of cols+1 */
+static char *out = NULL;
+static size_t out_len = 0;
+static int num_rows = 0;
+static int num_cols = 0;
+static int drawn = 0; /* lines in use by the last frame */
+static int rewritten = 0;
+
+static int open_proc(int pid, const char *name){
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int read_proc(int fd, char *buf, size_t size){
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    return 0;
+}
+
+int top_open(TopSample *s, int pid){
+    memset(s, 0, sizeof(TopSample));
+    s->pid = pid;
+    s->statm_fd = s->io_fd = -1;
+    s->stat_fd = open_proc(pid, "stat");
+    if (s->stat_fd != -1) s->statm_fd = open_proc(pid, "statm");
+    if (s->statm_fd == -1){
+        top_close(s);
+        return -1;
+    }
+    /* Missing without task I/O accounting */
+    s->io_fd = open_proc(pid, "io");
+    return 0;
+}
+
+int top_sample(TopSample *s, long long now){
+    static long clk_tck = 0;
+    static long page_size = 0;
+    char buf[1024];
+    char *p = NULL;
+    char state = '?';
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    unsigned long long rchar = 0;
+    unsigned long long wchar = 0;
+    long pages = 0;
+    double secs = (now - s->at) / 1e9;
+    if (clk_tck == 0){
+        clk_tck = sysconf(_SC_CLK_TCK);
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+    if (read_proc(s->stat_fd, buf, sizeof(buf)) == -1) return -1;
+    /* Fields after the command name, which may hold spaces: state is field 3,
+     * utime 14 and stime 15 */
+    p = strrchr(buf, ')');
+    if (p == NULL || sscanf(p + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &state, &utime, &stime) != 3) return -1;
+    if (read_proc(s->statm_fd, buf, sizeof(buf)) == -1 || sscanf(buf, "%*d %ld", &pages) != 1) return -1;
+    if (s->io_fd != -1 && (read_proc(s->io_fd, buf, sizeof(buf)) == -1 ||
+                           sscanf(buf, "rchar: %llu wchar: %llu", &rchar, &wchar) != 2)){
+        close(s->io_fd);
+        s->io_fd = -1;
+    }
+    if (s->at > 0 && secs > 0){
+        s->cpu_pct = 100.0 * (utime + stime - s->ticks) / clk_tck / secs;
+        s->read_rate = (rchar - s->rchar) / secs;
+        s->write_rate = (wchar - s->wchar) / secs;
+    }
+    s->state = state;
+    s->ticks = utime + stime;
+    s->rchar = rchar;
+    s->wchar = wchar;
+    s->rss = (long long)pages * page_size;
+    s->at = now;
+    return 0;
+}
+
+void top_close(TopSample *s){
+    if (s->stat_fd != -1) close(s->stat_fd);
+    if (s->statm_fd != -1) close(s->statm_fd);
+    if (s->io_fd != -1) close(s->io_fd);
+    s->stat_fd = s->statm_fd = s->io_fd = -1;
+}
+
+static void out_add(const char *text, size_t n){
+    memcpy(out + out_len, text, n);
+    out_len += n;
+}
+
+void screen_start(int rows, int cols){
+    num_rows = rows;
+    num_cols = cols;
+    drawn = 0;
+    lines = calloc(rows, cols + 1);
+    /* Every line rewritten, each with its cursor move and erase */
+    out = malloc(rows * (cols + 16));
+    if (lines == NULL || out == NULL) exit(1);
+    mem_add(MEM_INDEX, rows * (cols + 1) + rows * (cols + 16));
+    out_len = 0;
+    out_add("\033[H\033[2J", 7);
+}
+
+void screen_line(int row, const char *text){
+    char move[16];
+    char *line = NULL;
+    size_t n = strlen(text);
+    if (row >= num_rows) return;
+    line = lines + row * (num_cols + 1);
+    if (n > (size_t)num_cols) n = num_cols;
+    if (strncmp(line, text, n) == 0 && line[n] == '\0') return;
+    memcpy(line, text, n);
+    line[n] = '\0';
+    out_add(move, snprintf(move, sizeof(move), "\033[%d;1H", row + 1));
+    out_add(text, n);
+    out_add("\033[K", 3);
+    rewritten++;
+}
+
+int screen_flush(int used){
+    char move[16];
+    int n = 0;
+    int row = 0;
+    if (used > num_rows) used = num_rows;
+    for (row=used;row<drawn;row++){
+        if (lines[row * (num_cols + 1)] == '\0') continue;
+        lines[row * (num_cols + 1)] = '\0';
+        out_add(move, snprintf(move, sizeof(move), "\033[%d;1H\033[K", row + 1));
+        rewritten++;
+    }
+    drawn = used;
+    if (out_len > 0) write(STDOUT_FILENO, out, out_len);
+    out_len = 0;
+    n = rewritten;
+    rewritten = 0;
+    return n;
+}
+
+void screen_end(){
+    char move[16];
+    write(STDOUT_FILENO, move, snprintf(move, sizeof(move), "\033[%d;1H", drawn + 1));
+    mem_sub(MEM_INDEX, num_rows * (num_cols + 1) + num_rows * (num_cols + 16));
+    free(lines);
+    free(out);
+    lines = out = NULL;
+    num_rows = num_cols = drawn = 0;
+}
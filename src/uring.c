@@ -0,0 +1,236 @@
+/* io_uring event backend, see uring.h.
+ * - The rings are mapped once at startup; queuing a request is a store to
+ *   the submission ring, and only uring_submit() and a wait for an open
+ *   enter the kernel.
+ * - A waitid completion is kept as a pid in the ready list, so opens waited
+ *   on in between never lose a child's report.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/io_uring.h>
+#include "../inc/uring.h"
+#include "../inc/clock.h"
+
+/* IORING_OP_WAITID (Linux 6.7), newer than some kernel headers */
+#define URING_OP_WAITID 50
+#define URING_MAX_OPENS 4
+
+/* What a completion's user_data carries in its upper half */
+#define KIND_WAIT 1ULL
+#define KIND_OPEN 2ULL
+
+static int ring_fd = -1;
+static unsigned sq_entries = 0;
+static unsigned *sq_head = NULL;
+static unsigned *sq_tail = NULL;
+static unsigned *sq_mask = NULL;
+static unsigned *sq_flags = NULL;
+static unsigned *sq_array = NULL;
+static struct io_uring_sqe *sqes = NULL;
+static unsigned *cq_head = NULL;
+static unsigned *cq_tail = NULL;
+static unsigned *cq_mask = NULL;
+static struct io_uring_cqe *cqes = NULL;
+
+static int *open_fds[URING_MAX_OPENS]; /* where each open in flight reports */
+static int opens_pending = 0;
+static int *ready = NULL; /* pids reported and not yet applied */
+static int ready_count = 0;
+static int ready_size = 0;
+
+static int enter(unsigned to_submit, unsigned min_complete, unsigned flags){
+    return syscall(SYS_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Requests queued and not yet taken by the kernel */
+static unsigned unsubmitted(){
+    return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+}
+
+int uring_start(unsigned entries){
+    struct io_uring_params p;
+    struct io_uring_probe *probe = NULL;
+    size_t sq_len = 0;
+    size_t cq_len = 0;
+    char *sq = MAP_FAILED;
+    char *cq = MAP_FAILED;
+    int ok = 0;
+    memset(&p, 0, sizeof(p));
+    /* Room for a report from every child of a large batch that exits at once;
+     * more than that waits in the kernel's overflow list */
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 16;
+    ring_fd = syscall(SYS_io_uring_setup, entries, &p);
+    if (ring_fd == -1) return -1;
+    probe = calloc(1, sizeof(*probe) + 256*sizeof(struct io_uring_probe_op));
+    if (probe != NULL && syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0){
+        ok = probe->ops_len > URING_OP_WAITID
+          && (probe->ops[URING_OP_WAITID].flags & IO_URING_OP_SUPPORTED)
+          && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+          && (p.features & IORING_FEAT_NODROP);
+    }
+    free(probe);
+    if (ok){
+        sq_len = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP){
+            if (cq_len > sq_len) sq_len = cq_len;
+            cq_len = sq_len;
+        }
+        sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) cq = sq;
+        else cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        sqes = mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        ok = sq != MAP_FAILED && cq != MAP_FAILED && sqes != MAP_FAILED;
+    }
+    if (!ok){
+        /* The mappings go with the process; the shell exits on failure */
+        close(ring_fd);
+        ring_fd = -1;
+        return -1;
+    }
+    sq_entries = p.sq_entries;
+    sq_head = (unsigned*)(sq + p.sq_off.head);
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    sq_flags = (unsigned*)(sq + p.sq_off.flags);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+int uring_fd(){
+    return ring_fd;
+}
+
+/* Moves completions off the ring: opens report their descriptor, pids go to
+ * the ready list */
+static void collect(){
+    unsigned head = 0;
+    unsigned tail = 0;
+    struct io_uring_cqe *cqe = NULL;
+    int slot = 0;
+    do{
+        /* Completions that did not fit are flushed back by entering the ring */
+        if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW){
+            enter(0, 0, IORING_ENTER_GETEVENTS);
+        }
+        head = *cq_head;
+        tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (;head != tail;head++){
+            cqe = &cqes[head & *cq_mask];
+            if ((cqe->user_data >> 32) == KIND_OPEN){
+                slot = cqe->user_data & 0xffffffff;
+                *open_fds[slot] = cqe->res < 0 ? -1 : cqe->res;
+                open_fds[slot] = NULL;
+                opens_pending--;
+                continue;
+            }
+            if (ready_count == ready_size){
+                ready_size = ready_size ? ready_size*2 : 1024;
+                ready = realloc(ready, ready_size*sizeof(int));
+                if (ready == NULL) exit(1);
+            }
+            ready[ready_count++] = cqe->user_data & 0xffffffff;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    } while (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW);
+}
+
+int uring_submit(){
+    unsigned todo = unsubmitted();
+    int n = 0;
+    if (todo == 0) return 0;
+    while ((n = enter(todo, 0, 0)) == -1 && errno == EINTR);
+    /* A full completion ring refuses new work until it is emptied */
+    if (n == -1 && (errno == EBUSY || errno == EAGAIN)){
+        collect();
+        n = enter(todo, 0, 0);
+    }
+    return n;
+}
+
+/* The next free submission entry, cleared. A full ring is submitted first. */
+static struct io_uring_sqe *next_sqe(){
+    struct io_uring_sqe *sqe = NULL;
+    unsigned i = 0;
+    while (unsubmitted() == sq_entries){
+        if (uring_submit() == -1 && errno != EINTR && errno != EBUSY && errno != EAGAIN) exit(1);
+    }
+    i = *sq_tail & *sq_mask;
+    sqe = &sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[i] = i;
+    return sqe;
+}
+
+/* Hands the entry from next_sqe() to the kernel's side of the ring */
+static void queue_sqe(){
+    __atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+void uring_watch(int pid){
+    struct io_uring_sqe *sqe = next_sqe();
+    /* The kernel takes idtype from len, the id from fd and the options from
+     * file_index. No siginfo is needed: the shell collects the change. */
+    sqe->opcode = URING_OP_WAITID;
+    sqe->fd = pid;
+    sqe->len = P_PID;
+    sqe->file_index = WEXITED | WSTOPPED | WCONTINUED | WNOWAIT;
+    sqe->user_data = (KIND_WAIT << 32) | (uint32_t)pid;
+    queue_sqe();
+}
+
+void uring_open(const char *path, int flags, int mode, int *fd){
+    struct io_uring_sqe *sqe = NULL;
+    int slot = 0;
+    if (opens_pending == URING_MAX_OPENS) uring_wait_opens();
+    while (open_fds[slot] != NULL) slot++;
+    *fd = -1;
+    open_fds[slot] = fd;
+    opens_pending++;
+    sqe = next_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)path;
+    sqe->len = mode;
+    sqe->open_flags = flags | O_CLOEXEC;
+    sqe->user_data = (KIND_OPEN << 32) | slot;
+    queue_sqe();
+}
+
+void uring_wait_opens(){
+    int n = 0;
+    while (1){
+        collect();
+        if (opens_pending == 0) return;
+        /* Submits anything queued and sleeps until a completion arrives */
+        n = enter(unsubmitted(), 1, IORING_ENTER_GETEVENTS);
+        if (n == -1 && errno != EINTR && errno != EBUSY && errno != EAGAIN) exit(1);
+    }
+}
+
+int uring_drain(uring_fn fn){
+    long long ns = now_ns();
+    int count = 0;
+    int i = 0;
+    collect();
+    count = ready_count;
+    /* fn may queue requests of its own, which can add to the list */
+    for (i=0;i<ready_count;i++) fn(ready[i], ns);
+    ready_count = 0;
+    return count;
+}
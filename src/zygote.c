@@ -0,0 +1,262 @@
+/* Zygote spawn helper, see zygote.h.
+ * - A request is one message: a ZRequest, then the command line, argv and
+ *   the redirect file names as NUL-terminated strings, with the descriptors
+ *   attached. fd_slot says which attached descriptor plays which part.
+ * - The reply is one ZReply with the child's pidfd attached on success.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/sched.h>
+#include "../inc/zygote.h"
+
+#define ZYGOTE_MAX_FDS 5
+
+typedef struct zrequest{
+    int32_t task_num;
+    int32_t pgid;
+    int32_t argc;
+    int32_t has_infile;
+    int32_t has_outfile;
+    int32_t fd_slot[ZYGOTE_MAX_FDS]; /* in, out, unused, cap, status */
+} ZRequest;
+
+typedef struct zreply{
+    int32_t pid;
+    int32_t err;
+} ZReply;
+
+static int zfd = -1;
+
+/* Sends one message with up to ZYGOTE_MAX_FDS descriptors attached */
+static int send_fds(int fd, const void *buf, size_t len, const int *fds, int nfds){
+    char cbuf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)] = {0};
+    struct iovec iov = {(void*)buf, len};
+    struct msghdr msg = {0};
+    struct cmsghdr *c = NULL;
+    ssize_t n = 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0){
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+    }
+    while ((n = sendmsg(fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+/* Receives one message and its descriptors (close-on-exec). Returns the
+ * message length, 0 once the other end is gone, or -1 on error. */
+static ssize_t recv_fds(int fd, void *buf, size_t len, int *fds, int *nfds){
+    char cbuf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+    struct iovec iov = {buf, len};
+    struct msghdr msg = {0};
+    struct cmsghdr *c = NULL;
+    ssize_t n = 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    *nfds = 0;
+    while ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+    if (n <= 0) return n;
+    for (c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)){
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS){
+            *nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(c), sizeof(int) * *nfds);
+        }
+    }
+    return n;
+}
+
+/* Returns the next string in [*p, end) and steps past it, NULL if there is
+ * no terminated string left */
+static char *next_string(char **p, char *end){
+    char *s = *p;
+    char *nul = s < end ? memchr(s, '\0', end - s) : NULL;
+    if (nul == NULL) return NULL;
+    *p = nul + 1;
+    return s;
+}
+
+/* Forks a child of the shell rather than of the helper */
+static int clone_child(int *pidfd){
+    struct clone_args ca = {0};
+    ca.flags = CLONE_PARENT | CLONE_PIDFD;
+    ca.pidfd = (uint64_t)(uintptr_t)pidfd;
+    /* With CLONE_PARENT the shell is sent the helper's exit signal, SIGCHLD */
+    ca.exit_signal = 0;
+    return syscall(SYS_clone3, &ca, sizeof(ca));
+}
+
+/* Starts the child one request asks for. Returns the pid, or -1 with errno set. */
+static int serve_one(char *buf, size_t len, int *fds, int nfds, zygote_child_fn fn, int *pidfd){
+    ZRequest req;
+    SpawnArgs a = {0};
+    int *slots[ZYGOTE_MAX_FDS] = {&a.in_fd, &a.out_fd, &a.unused_fd, &a.cap_fd, &a.status_fd};
+    char *p = buf + sizeof(req);
+    char *end = buf + len;
+    char **argv = NULL;
+    int pid = -1;
+    int i = 0;
+    if (len < sizeof(req)){
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&req, buf, sizeof(req));
+    for (i=0;i<ZYGOTE_MAX_FDS;i++){
+        if (req.fd_slot[i] >= nfds){
+            errno = EINVAL;
+            return -1;
+        }
+        *slots[i] = req.fd_slot[i] < 0 ? -1 : fds[req.fd_slot[i]];
+    }
+    if (req.argc < 1 || (size_t)req.argc > len){
+        errno = EINVAL;
+        return -1;
+    }
+    argv = calloc(req.argc + 1, sizeof(char*));
+    if (argv == NULL) return -1;
+    a.task_num = req.task_num;
+    a.pgid = req.pgid;
+    a.argv = argv;
+    a.cmd = next_string(&p, end);
+    for (i=0;i<req.argc;i++) argv[i] = next_string(&p, end);
+    if (req.has_infile) a.infile = next_string(&p, end);
+    if (req.has_outfile) a.outfile = next_string(&p, end);
+    if (a.cmd == NULL || argv[req.argc-1] == NULL || (req.has_infile && a.infile == NULL) ||
+        (req.has_outfile && a.outfile == NULL)){
+        free(argv);
+        errno = EINVAL;
+        return -1;
+    }
+    pid = clone_child(pidfd);
+    if (pid == 0) fn(&a);
+    free(argv);
+    return pid;
+}
+
+/* The helper's loop: one child per request until the shell goes away */
+static void serve(int fd, zygote_child_fn fn){
+    char *buf = malloc(ZYGOTE_MAX_MSG);
+    int fds[ZYGOTE_MAX_FDS];
+    int nfds = 0;
+    int pidfd = -1;
+    int i = 0;
+    ssize_t n = 0;
+    ZReply rep;
+    if (buf == NULL) _exit(1);
+    while ((n = recv_fds(fd, buf, ZYGOTE_MAX_MSG, fds, &nfds)) > 0){
+        pidfd = -1;
+        rep.pid = serve_one(buf, n, fds, nfds, fn, &pidfd);
+        rep.err = rep.pid == -1 ? errno : 0;
+        for (i=0;i<nfds;i++) close(fds[i]);
+        send_fds(fd, &rep, sizeof(rep), &pidfd, pidfd != -1);
+        if (pidfd != -1) close(pidfd);
+    }
+    _exit(0);
+}
+
+int zygote_start(zygote_child_fn fn){
+    int sv[2];
+    int parent = getpid();
+    int pid = 0;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) return -1;
+    pid = fork();
+    if (pid == -1){
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0){
+        close(sv[0]);
+        /* Keyboard signals are for the shell and its foreground task */
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) _exit(0);
+        serve(sv[1], fn);
+    }
+    close(sv[1]);
+    zfd = sv[0];
+    return pid;
+}
+
+/* Appends s and its NUL to a request of *len bytes */
+static int put_string(char *buf, size_t *len, const char *s){
+    size_t n = strlen(s) + 1;
+    if (*len + n > ZYGOTE_MAX_MSG){
+        errno = E2BIG;
+        return -1;
+    }
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return 0;
+}
+
+int zygote_spawn(const SpawnArgs *a, int *pidfd){
+    char buf[ZYGOTE_MAX_MSG];
+    ZRequest req = {0};
+    ZReply rep;
+    const int fd_of[ZYGOTE_MAX_FDS] = {a->in_fd, a->out_fd, a->unused_fd, a->cap_fd, a->status_fd};
+    int fds[ZYGOTE_MAX_FDS];
+    int nfds = 0;
+    int got = -1;
+    int n_got = 0;
+    size_t len = sizeof(req);
+    int i = 0;
+    if (zfd == -1){
+        errno = ENOTCONN;
+        return -1;
+    }
+    for (i=0;i<ZYGOTE_MAX_FDS;i++){
+        req.fd_slot[i] = fd_of[i] == -1 ? -1 : nfds;
+        if (fd_of[i] != -1) fds[nfds++] = fd_of[i];
+    }
+    req.task_num = a->task_num;
+    req.pgid = a->pgid;
+    req.has_infile = a->infile != NULL;
+    req.has_outfile = a->outfile != NULL;
+    /* Strings in order: cmd, argv..., infile, outfile */
+    while (a->argv[req.argc] != NULL) req.argc++;
+    if (put_string(buf, &len, a->cmd) == -1) return -1;
+    for (i=0;i<req.argc;i++){
+        if (put_string(buf, &len, a->argv[i]) == -1) return -1;
+    }
+    if (a->infile != NULL && put_string(buf, &len, a->infile) == -1) return -1;
+    if (a->outfile != NULL && put_string(buf, &len, a->outfile) == -1) return -1;
+    memcpy(buf, &req, sizeof(req));
+    if (send_fds(zfd, buf, len, fds, nfds) == -1 ||
+        recv_fds(zfd, &rep, sizeof(rep), &got, &n_got) != sizeof(rep)){
+        /* The helper is gone; the caller forks from here on */
+        zygote_stop();
+        errno = ECHILD;
+        return -1;
+    }
+    if (rep.pid == -1){
+        errno = rep.err;
+        return -1;
+    }
+    if (n_got == 1 && pidfd != NULL) *pidfd = got;
+    else if (n_got == 1) close(got);
+    return rep.pid;
+}
+
+void zygote_stop(){
+    if (zfd == -1) return;
+    close(zfd);
+    zfd = -1;
+}